@@ -151,6 +151,16 @@ std::shared_ptr<Entity> MakeObject(std::wstring name, std::shared_ptr<GeometryLa
 	return objectEntity;
 }
 
+std::string StringFromTime(std::chrono::system_clock::time_point const& tp)
+{
+	std::time_t t = std::chrono::system_clock::to_time_t(tp);
+	tm tmstruct;
+	localtime_s(&tmstruct, &t);
+	std::stringstream ss;
+	ss << std::put_time(&tmstruct, "%Y-%m-%d_%H-%M-%S"); // convert to calendar time
+	return ss.str();
+}
+
 struct GlobalController
 	: public InputHandler
 {
@@ -163,6 +173,11 @@ struct GlobalController
 	static const s32 IncreaseThread = 20;
 	static const s32 DecreaseThread = 21;
 	static const s32 ToggleStatistic = 30;
+	static const s32 RunBenchmark = 40;
+	static const s32 ToggleVertexCache = 50;
+	static const s32 ToggleMeshletCulling = 51;
+	static const s32 ToggleLightCulling = 52;
+	static const s32 ToggleClusteredLighting = 53;
 	static ActionMap CreateActionMap()
 	{
 		ActionMap map;
@@ -175,6 +190,11 @@ struct GlobalController
 		map.Set(InputManager::InputSemantic::K_LeftBracket, DecreaseThread);
 		map.Set(InputManager::InputSemantic::K_RightBracket, IncreaseThread);
 		map.Set(InputManager::InputSemantic::K_Enter, ToggleStatistic);
+		map.Set(InputManager::InputSemantic::K_F9, RunBenchmark);
+		map.Set(InputManager::InputSemantic::K_F10, ToggleVertexCache);
+		map.Set(InputManager::InputSemantic::K_F11, ToggleMeshletCulling);
+		map.Set(InputManager::InputSemantic::K_F7, ToggleLightCulling);
+		map.Set(InputManager::InputSemantic::K_F8, ToggleClusteredLighting);
 		return map;
 	}
 
@@ -199,12 +219,15 @@ struct GlobalController
 		f32 renderingTime;
 
 		f32 rasterizeTime;
+		f32 lightCullingTime;
+		f32 lightAssignmentTime;
+		f32 lightBVHBuildTime;
 	};
 
 
 	GlobalController(Context& theContext)
 		: InputHandler(theContext.GetInputManager(), CreateActionMap()), context(theContext), renderer(theContext.GetRenderer()),
-		statisticState(false), statisticPreviousState(false)
+		statisticState(false), statisticPreviousState(false), benchmarkStep(-1)
 	{
 		ResetStaticsticPack();
 		Scene& scene = context.GetScene();
@@ -224,7 +247,17 @@ struct GlobalController
 
 		//auto objectMesh = context.GetResourceLoader().LoadMesh("Data/jeep/jeep1.fbx");
 		//auto objectMesh = context.GetResourceLoader().LoadMesh("Data/dabrovic-sponza/sponza.obj");
-		auto objectMesh = context.GetResourceLoader().LoadMesh("Data/crytek-sponza/sponza.obj");
+		context.GetResourceLoader().SetMeshOptimization(true);
+		context.GetResourceLoader().SetVertexCompression(true);
+		context.GetResourceLoader().SetLevelOfDetailGeneration(true);
+		auto objectMesh = context.GetResourceLoader().LoadMesh("Data/crytek-sponza/sponza.obj", true);
+		sceneMesh = objectMesh.get();
+		MeshOptimizationStatistics optimizationStatistics = context.GetResourceLoader().GetMeshOptimizationStatistics();
+		if (optimizationStatistics.triangleCount > 0)
+		{
+			std::cout << "ACMR before optimization: " << f64(optimizationStatistics.shadedVertexCountBefore) / optimizationStatistics.triangleCount
+				<< ", after: " << f64(optimizationStatistics.shadedVertexCountAfter) / optimizationStatistics.triangleCount << std::endl;
+		}
 
 		auto surfaceShader = std::make_shared<PhongShader>();
 		for (u32 i = 0; i < objectMesh->GetSubMeshCount(); ++i)
@@ -240,24 +273,27 @@ struct GlobalController
 		auto material = MakeMaterial(diffuseTexture);
 
 		// 	const u32 Count = 4;
+		// 	std::vector<f32M44> instances;
 		// 	for (u32 i = 0; i < Count; ++i)
 		// 	{
 		// 		for (u32 j = 0; j < Count; ++j)
 		// 		{
 		// 			for (u32 k = 0; k < Count; ++k)
 		// 			{
-		// 				std::wstring name = std::wstring(L"object") + std::to_wstring(k) + std::to_wstring(j) + std::to_wstring(i);
-		// 				std::shared_ptr<Entity> object = MakeObject(std::move(name), layout, material);
 		// 				auto get = [=] (u32 v)
 		// 				{
 		// 					return f32(v) / (Count - 1) - 0.5f;
 		// 				};
 		// 				f32V3 position(get(k), get(j), get(i));
-		// 				object->GetComponent<Transformation>()->Translate(position * 15.f * f32(Count - 1));
-		// 				scene.AddEntity(object);
+		// 				instances.push_back(TranslationMatrix(position * 15.f * f32(Count - 1)));
 		// 			}
 		// 		}
 		// 	}
+		// 	std::unique_ptr<InstancedMesh> objects = std::make_unique<InstancedMesh>(std::make_shared<GeometryLayout>(layout.first, layout.second), material);
+		// 	objects->SetInstances(std::move(instances));
+		// 	std::shared_ptr<Entity> object = std::make_shared<Entity>(L"instanced objects");
+		// 	object->SetComponent<Renderable>(std::move(objects));
+		// 	scene.AddEntity(object);
 
 
 		std::shared_ptr<Entity> ambientLightEntity = std::make_shared<Entity>(L"ambient light");
@@ -343,16 +379,18 @@ struct GlobalController
 			f32 prezTime = performanceCounter.Get(PerformanceCounter::Term::ForwardPreZPass);
 			f32 renderingTime = performanceCounter.Get(PerformanceCounter::Term::ForwardRenderPass);
 			f32 rasterizeTime = performanceCounter.Get(PerformanceCounter::Term::ForwardTotalRasterize);
+			f32 lightCullingTime = performanceCounter.Get(PerformanceCounter::Term::ForwardLightCulling);
+			f32 lightAssignmentTime = performanceCounter.Get(PerformanceCounter::Term::ClusteredLightAssignment);
+			f32 lightBVHBuildTime = performanceCounter.Get(PerformanceCounter::Term::LightBVHBuild);
+
+			RasterizerStatistics rasterizerStatistics = context.GetRenderer().GetPipeline()->GetRasterizerStatistics();
+			VertexStatistics vertexStatistics = context.GetRenderer().GetPipeline()->GetVertexStatistics();
+			TriangleStatistics triangleStatistics = context.GetRenderer().GetPipeline()->GetTriangleStatistics();
 
-			auto stringFromTime = [] (std::chrono::system_clock::time_point const& tp)
+			if (benchmarkStep >= 0)
 			{
-				std::time_t t = std::chrono::system_clock::to_time_t(tp);
-				tm tmstruct;
-				localtime_s(&tmstruct, &t);
-				std::stringstream ss;
-				ss << std::put_time(&tmstruct, "%Y-%m-%d_%H-%M-%S"); // convert to calendar time
-				return ss.str();
-			};
+				UpdateBenchmark(geometryPassTime);
+			}
 
 			// TODO not work, need to find why
 			if (!statisticPreviousState && statisticState) // start
@@ -382,10 +420,13 @@ struct GlobalController
 				average.prezTime = staticsticPack.prezTime / staticsticPack.frameCount;
 				average.renderingTime = staticsticPack.renderingTime / staticsticPack.frameCount;
 				average.rasterizeTime = staticsticPack.rasterizeTime / staticsticPack.frameCount;
+				average.lightCullingTime = staticsticPack.lightCullingTime / staticsticPack.frameCount;
+				average.lightAssignmentTime = staticsticPack.lightAssignmentTime / staticsticPack.frameCount;
+				average.lightBVHBuildTime = staticsticPack.lightBVHBuildTime / staticsticPack.frameCount;
 
 
 
-				std::string configString = stringFromTime(std::chrono::system_clock::now()) + " " + (deferred ? "D " : "F ")
+				std::string configString = StringFromTime(std::chrono::system_clock::now()) + " " + (deferred ? "D " : "F ")
 					+ std::to_string(context.GetThreadSupport()) + " " + std::to_string(currentLightCount);
 				std::ofstream performanceLog("../log." + configString + ".txt");
 				//if (performanceLog)
@@ -405,6 +446,9 @@ struct GlobalController
 							<< "   " << std::setw(29) << "tiled culling: " << average.tiledCullingTime << ", " << average.tiledCullingTime / average.fullTime << "\n"
 							<< "   " << std::setw(29) << "tiled shading: " << average.tiledShadingTime << ", " << average.tiledShadingTime / average.fullTime << "\n"
 							<< "  " << std::setw(30) << "prez pass: " << average.prezTime << ", " << average.prezTime / average.fullTime << "\n"
+							<< "  " << std::setw(30) << "light culling: " << average.lightCullingTime << ", " << average.lightCullingTime / average.fullTime << "\n"
+							<< "  " << std::setw(30) << "light bvh build: " << average.lightBVHBuildTime << ", " << average.lightBVHBuildTime / average.fullTime << "\n"
+							<< "  " << std::setw(30) << "light assignment: " << average.lightAssignmentTime << ", " << average.lightAssignmentTime / average.fullTime << "\n"
 							<< "  " << std::setw(30) << "rendering pass: " << average.renderingTime << ", " << average.renderingTime / average.fullTime << "\n"
 							<< "   " << std::setw(29) << "rasterize: " << average.rasterizeTime << ", " << average.rasterizeTime / average.fullTime << "\n"
 							<< "-------------------------------------------------------------------------" << std::endl;
@@ -418,6 +462,9 @@ struct GlobalController
 							<< "  " << std::setw(30) << "geometry pass: " << average.geometryPassTime << ", " << average.geometryPassTime / average.fullTime << "\n"
 							<< "  " << std::setw(30) << "shading pass: " << average.shadingPassTime << ", " << average.shadingPassTime / average.fullTime << "\n"
 							<< "  " << std::setw(30) << "prez pass: " << average.prezTime << ", " << average.prezTime / average.fullTime << "\n"
+							<< "  " << std::setw(30) << "light culling: " << average.lightCullingTime << ", " << average.lightCullingTime / average.fullTime << "\n"
+							<< "  " << std::setw(30) << "light bvh build: " << average.lightBVHBuildTime << ", " << average.lightBVHBuildTime / average.fullTime << "\n"
+							<< "  " << std::setw(30) << "light assignment: " << average.lightAssignmentTime << ", " << average.lightAssignmentTime / average.fullTime << "\n"
 							<< "  " << std::setw(30) << "rendering pass: " << average.renderingTime << ", " << average.renderingTime / average.fullTime << "\n"
 							<< "-------------------------------------------------------------------------" << std::endl;
 					}
@@ -446,6 +493,9 @@ struct GlobalController
 				staticsticPack.prezTime += prezTime;
 				staticsticPack.renderingTime += renderingTime;
 				staticsticPack.rasterizeTime += rasterizeTime;
+				staticsticPack.lightCullingTime += lightCullingTime;
+				staticsticPack.lightAssignmentTime += lightAssignmentTime;
+				staticsticPack.lightBVHBuildTime += lightBVHBuildTime;
 			}
 			else // off
 			{
@@ -468,8 +518,24 @@ struct GlobalController
 				<< "   " << std::setw(29) << "tiled culling: " << tiledCullingTime << ", " << tiledCullingTime / fullTime << "\n"
 				<< "   " << std::setw(29) << "tiled shading: " << tiledShadingTime << ", " << tiledShadingTime / fullTime << "\n"
 				<< "  " << std::setw(30) << "prez pass: " << prezTime << ", " << prezTime / fullTime << "\n"
+				<< "  " << std::setw(30) << "light culling: " << lightCullingTime << ", " << lightCullingTime / fullTime << "\n"
+				<< "  " << std::setw(30) << "light bvh build: " << lightBVHBuildTime << ", " << lightBVHBuildTime / fullTime << "\n"
+				<< "  " << std::setw(30) << "light assignment: " << lightAssignmentTime << ", " << lightAssignmentTime / fullTime << "\n"
 				<< "  " << std::setw(30) << "rendering pass: " << renderingTime << ", " << renderingTime / fullTime << "\n"
 				<< "   " << std::setw(29) << "rasterize: " << rasterizeTime << ", " << rasterizeTime / fullTime << "\n"
+				<< "" << std::setw(32) << "blocks accepted: " << rasterizerStatistics.acceptedBlockCount << "\n"
+				<< "" << std::setw(32) << "blocks rejected: " << rasterizerStatistics.rejectedBlockCount << "\n"
+				<< "" << std::setw(32) << "blocks split: " << rasterizerStatistics.splitBlockCount << "\n"
+				<< "" << std::setw(32) << "blocks occluded: " << rasterizerStatistics.occludedBlockCount << "\n"
+				<< "" << std::setw(32) << "vertices: " << vertexStatistics.vertexCount << "\n"
+				<< "" << std::setw(32) << "vertices unique shaded: " << vertexStatistics.uniqueVertexCount << "\n"
+				<< "" << std::setw(32) << "vertex shader invocations: " << vertexStatistics.shadedVertexCount << "\n"
+				<< "" << std::setw(32) << "triangles: " << vertexStatistics.triangleCount << "\n"
+				<< "" << std::setw(32) << "triangles outside: " << triangleStatistics.outsideCount << "\n"
+				<< "" << std::setw(32) << "triangles zero area: " << triangleStatistics.zeroAreaCount << "\n"
+				<< "" << std::setw(32) << "triangles back facing: " << triangleStatistics.backFacingCount << "\n"
+				<< "" << std::setw(32) << "triangles sub pixel: " << triangleStatistics.subPixelCount << "\n"
+				<< "" << std::setw(32) << "triangles accepted: " << triangleStatistics.acceptedCount << "\n"
 				<< "-------------------------------------------------------------------------" << std::endl;
 
 			//logFile << ss.str();
@@ -544,6 +610,39 @@ struct GlobalController
 				case ToggleStatistic:
 					statisticState = !statisticState;
 					break;
+				case RunBenchmark:
+					if (benchmarkStep < 0)
+					{
+						StartBenchmark();
+					}
+					break;
+				case ToggleVertexCache:
+					{
+						Pipeline::VertexProcessingMode mode = pDeferred->GetVertexProcessingMode() == Pipeline::VertexProcessingMode::Batched
+							? Pipeline::VertexProcessingMode::PostTransformCache : Pipeline::VertexProcessingMode::Batched;
+						pDeferred->SetVertexProcessingMode(mode);
+						pForward->SetVertexProcessingMode(mode);
+					}
+					break;
+				case ToggleMeshletCulling:
+					sceneMesh->SetMeshletCulling(!sceneMesh->GetMeshletCulling());
+					break;
+				case ToggleLightCulling:
+					pForward->SetLightCullingMode(pForward->GetLightCullingMode() == ForwardPipeline::LightCullingMode::Tiled
+						? ForwardPipeline::LightCullingMode::None : ForwardPipeline::LightCullingMode::Tiled);
+					break;
+				case ToggleClusteredLighting:
+					if (pDeferred->GetLightCullingMode() == DefferredPipeline::LightCullingMode::Clustered)
+					{
+						pDeferred->SetLightCullingMode(DefferredPipeline::LightCullingMode::Tiled);
+						pForward->SetLightCullingMode(ForwardPipeline::LightCullingMode::Tiled);
+					}
+					else
+					{
+						pDeferred->SetLightCullingMode(DefferredPipeline::LightCullingMode::Clustered);
+						pForward->SetLightCullingMode(ForwardPipeline::LightCullingMode::Clustered);
+					}
+					break;
 				default:
 					assert(false);
 					break;
@@ -562,10 +661,91 @@ struct GlobalController
 		std::memset(&staticsticPack, 0, sizeof(staticsticPack));
 	}
 
+	/*
+	*	Deferred geometry pass time of the tile binned and the atomic depth pass at BenchmarkThreads threads,
+	*	averaged over BenchmarkFrameCount frames each. Thread support 1 is the single threaded path.
+	*/
+	static const u32 BenchmarkFrameCount = 64;
+	static const u32 BenchmarkThreadCount = 4;
+	static const u32 BenchmarkThreads[BenchmarkThreadCount];
+	static const u32 BenchmarkStepCount = 2 * BenchmarkThreadCount;
+
+	void StartBenchmark()
+	{
+		benchmarkPreviousForward = renderer.GetPipeline() == pForward;
+		if (benchmarkPreviousForward)
+		{
+			ForwardPipeline* forward = CheckedCast<ForwardPipeline*>(renderer.SetPipeline(std::move(deferredPipeline)).release());
+			forwardPipeline = std::unique_ptr<ForwardPipeline>(forward);
+		}
+		benchmarkPreviousThreadSupport = context.GetThreadSupport();
+		benchmarkPreviousMode = pDeferred->GetGeometryPassMode();
+		benchmarkStep = 0;
+		ApplyBenchmarkStep();
+	}
+
+	void ApplyBenchmarkStep()
+	{
+		pDeferred->SetGeometryPassMode(benchmarkStep < s32(BenchmarkThreadCount)
+			? DefferredPipeline::GeometryPassMode::TileBinned : DefferredPipeline::GeometryPassMode::AtomicDepth);
+		context.SetThreadSupport(BenchmarkThreads[benchmarkStep % BenchmarkThreadCount]);
+		benchmarkFrame = 0;
+		benchmarkTimes[benchmarkStep] = 0;
+	}
+
+	// the first frame after a step change is rendered with the new configuration, timings read in it are of the previous one
+	void UpdateBenchmark(f32 geometryPassTime)
+	{
+		if (benchmarkFrame > 0)
+		{
+			benchmarkTimes[benchmarkStep] += geometryPassTime;
+		}
+		benchmarkFrame += 1;
+		if (benchmarkFrame <= BenchmarkFrameCount)
+		{
+			return;
+		}
+		benchmarkTimes[benchmarkStep] /= BenchmarkFrameCount;
+		benchmarkStep += 1;
+		if (benchmarkStep < s32(BenchmarkStepCount))
+		{
+			ApplyBenchmarkStep();
+			return;
+		}
+
+		std::string configString = StringFromTime(std::chrono::system_clock::now()) + " benchmark " + std::to_string(currentLightCount);
+		std::stringstream ss;
+		ss << configString << "\n" << std::left
+			<< "" << std::setw(16) << "threads" << std::setw(24) << "tile binned" << std::setw(24) << "atomic depth" << "\n";
+		for (u32 i = 0; i < BenchmarkThreadCount; ++i)
+		{
+			f32 tileBinned = benchmarkTimes[i];
+			f32 atomicDepth = benchmarkTimes[BenchmarkThreadCount + i];
+			ss << "" << std::setw(16) << BenchmarkThreads[i]
+				<< std::setw(24) << (std::to_string(tileBinned) + ", " + std::to_string(benchmarkTimes[0] / tileBinned))
+				<< std::setw(24) << (std::to_string(atomicDepth) + ", " + std::to_string(benchmarkTimes[0] / atomicDepth)) << "\n";
+		}
+		ss << "(geometry pass time, speedup over tile binned single thread)" << "\n"
+			<< "-------------------------------------------------------------------------" << std::endl;
+		std::ofstream performanceLog("../log." + configString + ".txt");
+		performanceLog << ss.str();
+		std::cout << ss.str();
+
+		benchmarkStep = -1;
+		pDeferred->SetGeometryPassMode(benchmarkPreviousMode);
+		context.SetThreadSupport(benchmarkPreviousThreadSupport);
+		if (benchmarkPreviousForward)
+		{
+			DefferredPipeline* deferred = CheckedCast<DefferredPipeline*>(renderer.SetPipeline(std::move(forwardPipeline)).release());
+			deferredPipeline = std::unique_ptr<DefferredPipeline>(deferred);
+		}
+	}
+
 	Context& context;
 	Renderer& renderer;
 	std::shared_ptr<FirstPersonCameraController> cameraController;
 	std::shared_ptr<FirstPersonCameraController> directionalLightController;
+	Mesh* sceneMesh; // owned by its entity
 	std::vector<std::shared_ptr<Entity>> pointLightEntities;
 	u32 currentLightCount;
 	std::unique_ptr<ForwardPipeline> forwardPipeline;
@@ -577,8 +757,17 @@ struct GlobalController
 	bool statisticState;
 	StatisticPack staticsticPack;
 
+	s32 benchmarkStep; // -1 if not running
+	u32 benchmarkFrame;
+	std::array<f32, BenchmarkStepCount> benchmarkTimes;
+	u32 benchmarkPreviousThreadSupport;
+	DefferredPipeline::GeometryPassMode benchmarkPreviousMode;
+	bool benchmarkPreviousForward; // the forward pipeline was active before the benchmark
+
 };
 
+const u32 GlobalController::BenchmarkThreads[GlobalController::BenchmarkThreadCount] = { 1, 4, 16, 64 };
+
 
 void Run()
 {
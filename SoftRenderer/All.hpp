@@ -20,6 +20,7 @@
 #include "Light.hpp"
 #include "Material.hpp"
 #include "Mesh.hpp"
+#include "InstancedMesh.hpp"
 #include "Pipeline.hpp"
 #include "Renderable.hpp"
 #include "Renderer.hpp"
@@ -1,5 +1,6 @@
 #include "Header.hpp"
 #include "Buffer.hpp"
+#include "VertexCompression.hpp"
 
 namespace X
 {
@@ -11,5 +12,17 @@ namespace X
 	Buffer::~Buffer()
 	{
 	}
-}
 
+
+	void VertexBuffer::Compress(BoundingBox const& bounds)
+	{
+		quantization_ = MakeVertexQuantization(bounds);
+		compactVertices_.resize(vertices_.size());
+		for (u32 i = 0; i < vertices_.size(); ++i)
+		{
+			compactVertices_[i] = CompressVertex(vertices_[i], quantization_);
+		}
+		vertices_ = std::vector<Vertex>();
+		compressed_ = true;
+	}
+}
@@ -13,11 +13,73 @@ namespace X
 	};
 
 
+	/*
+	*	Triangle list indices, 16 bit if every vertex index fits, 32 bit for meshes of more vertices.
+	*/
+	class IndexData
+	{
+	public:
+		enum class Format
+		{
+			U16,
+			U32,
+		};
+
+	public:
+		IndexData()
+			: format_(Format::U16)
+		{
+		}
+		IndexData(std::vector<u16> indices)
+			: format_(Format::U16), indices16_(std::move(indices))
+		{
+		}
+		IndexData(std::vector<u32> indices)
+			: format_(Format::U32), indices32_(std::move(indices))
+		{
+		}
+
+		Format GetFormat() const
+		{
+			return format_;
+		}
+		u32 GetCount() const
+		{
+			return format_ == Format::U16 ? u32(indices16_.size()) : u32(indices32_.size());
+		}
+		bool IsEmpty() const
+		{
+			return GetCount() == 0;
+		}
+
+		/*
+		*	Call function with the std::vector of the format, code reading indices is instantiated for both widths.
+		*/
+		template <typename FunctionT>
+		auto Visit(FunctionT const& function) const -> decltype(function(std::vector<u16>()))
+		{
+			if (format_ == Format::U16)
+			{
+				return function(indices16_);
+			}
+			else
+			{
+				return function(indices32_);
+			}
+		}
+
+	private:
+		Format format_;
+		std::vector<u16> indices16_;
+		std::vector<u32> indices32_;
+	};
+
+
 	class IndexBuffer
 		: public Buffer
 	{
 	public:
-		IndexBuffer(std::vector<u16> indices)
+		IndexBuffer(IndexData indices)
 			: indices_(std::move(indices))
 		{
 		}
@@ -25,17 +87,17 @@ namespace X
 		{
 		}
 
-		void SetData(std::vector<u16> indices)
+		void SetData(IndexData indices)
 		{
 			indices_ = std::move(indices);
 		}
-		std::vector<u16> const& GetData() const
+		IndexData const& GetData() const
 		{
 			return indices_;
 		}
 
 	private:
-		std::vector<u16> indices_;
+		IndexData indices_;
 	};
 
 
@@ -45,7 +107,7 @@ namespace X
 	{
 	public:
 		VertexBuffer(std::vector<Vertex> vertices)
-			: vertices_(std::move(vertices))
+			: vertices_(std::move(vertices)), compressed_(false), quantization_()
 		{
 		}
 		virtual ~VertexBuffer() override
@@ -55,14 +117,49 @@ namespace X
 		void SetData(std::vector<Vertex> vertices)
 		{
 			vertices_ = std::move(vertices);
+			compactVertices_ = std::vector<CompactVertex>();
+			compressed_ = false;
 		}
+		/*
+		*	Empty if compressed.
+		*/
 		std::vector<Vertex> const& GetData() const
 		{
 			return vertices_;
 		}
 
+		/*
+		*	Replace the vertices with CompactVertex of half the size, lossy.
+		*	Code reading the vertices themselves, like building meshlets, has to run before.
+		*	@bounds: contains every position, the quantization spans it.
+		*/
+		void Compress(BoundingBox const& bounds);
+		bool IsCompressed() const
+		{
+			return compressed_;
+		}
+		/*
+		*	Empty if not compressed.
+		*/
+		std::vector<CompactVertex> const& GetCompressedData() const
+		{
+			return compactVertices_;
+		}
+		VertexQuantization const& GetQuantization() const
+		{
+			return quantization_;
+		}
+
+		u32 GetCount() const
+		{
+			return compressed_ ? compactVertices_.size() : vertices_.size();
+		}
+
 	private:
 		std::vector<Vertex> vertices_;
+		bool compressed_;
+		std::vector<CompactVertex> compactVertices_;
+		VertexQuantization quantization_;
 	};
 }
 
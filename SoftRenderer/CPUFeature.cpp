@@ -0,0 +1,60 @@
+#include "Header.hpp"
+#include "CPUFeature.hpp"
+
+#include <intrin.h>
+#include <immintrin.h>
+
+namespace X
+{
+	namespace
+	{
+		bool Bit(s32 value, u32 bit)
+		{
+			return (static_cast<u32>(value) & (1u << bit)) != 0;
+		}
+
+		CPUFeature DetectCPUFeature()
+		{
+			CPUFeature feature;
+			feature.sse41 = false;
+			feature.avx = false;
+			feature.avx2 = false;
+			feature.fma = false;
+			feature.f16c = false;
+
+			std::array<s32, 4> info; // eax, ebx, ecx, edx
+			__cpuid(info.data(), 0);
+			s32 maxLeaf = info[0];
+			if (maxLeaf < 1)
+			{
+				return feature;
+			}
+
+			__cpuid(info.data(), 1);
+			feature.sse41 = Bit(info[2], 19);
+			bool osxsave = Bit(info[2], 27);
+			bool avx = Bit(info[2], 28);
+			bool fma = Bit(info[2], 12);
+			bool f16c = Bit(info[2], 29);
+
+			// ymm registers have to be saved by the operating system
+			bool ymmEnabled = osxsave && (_xgetbv(0) & 0x6) == 0x6;
+			feature.avx = avx && ymmEnabled;
+			feature.fma = fma && feature.avx;
+			feature.f16c = f16c && feature.avx;
+
+			if (maxLeaf >= 7)
+			{
+				__cpuidex(info.data(), 7, 0);
+				feature.avx2 = Bit(info[1], 5) && feature.avx;
+			}
+			return feature;
+		}
+	}
+
+	CPUFeature const& GetCPUFeature()
+	{
+		static CPUFeature const feature = DetectCPUFeature();
+		return feature;
+	}
+}
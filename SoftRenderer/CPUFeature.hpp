@@ -0,0 +1,22 @@
+#pragma once
+#include "Common.hpp"
+
+namespace X
+{
+	/*
+	*	Instruction sets supported by both the processor and the operating system.
+	*/
+	struct CPUFeature
+	{
+		bool sse41;
+		bool avx;
+		bool avx2;
+		bool fma;
+		bool f16c;
+	};
+
+	/*
+	*	Detected with CPUID on first call, select SIMD code paths with it.
+	*/
+	CPUFeature const& GetCPUFeature();
+}
@@ -40,6 +40,7 @@ namespace X
 
 	class ResourceLoader;
 	class Mesh;
+	class InstancedMesh;
 	class Material;
 	class Sampler;
 	class Texture2D;
@@ -17,10 +17,19 @@
 #include "Shader.hpp"
 #include "ThreadedTaskPool.hpp"
 #include "Rasterizer.hpp"
+#include "TileBinner.hpp"
+#include "TriangleCuller.hpp"
+#include "DrawCollector.hpp"
+#include "VertexTransform.hpp"
+#include "LightCulling.hpp"
+#include "LightBVH.hpp"
+#include "PointLightTable.hpp"
+#include "LightGrid.hpp"
 #include "PerformanceCounter.hpp"
 #include "GeometryLayout.hpp"
 
 #include <ppl.h>
+#include <atomic>
 
 namespace X
 {
@@ -51,10 +60,11 @@ namespace X
 			DirectionalLight* directionalLight;
 			f32V3 directionalLightViewDirection;
 			f32V3 directionalLightHalfVector;
-			std::vector<PointLight*> pointLights;
-			std::vector<f32V3> pointLightViewPositions;
+			PointLightTable const* pointLights; // owned by the pipeline
+			LightBVH const* pointLightBVH;
 			f32M44 projectionMatrix;
 			f32 far;
+			LightGrid const* lightGrid; // nullptr to cull the lights per tile
 			PerformanceCounter* pc;
 		};
 
@@ -69,25 +79,10 @@ namespace X
 		{
 			ConcreteTexture2D<GBufferElement>* gBuffer;
 			ConcreteTexture2D<f32V3>* colorBuffer;
+			std::vector<std::vector<u32>>* tileLightIndices; // one per work group, storage reused between frames
 		};
 
 
-		struct TransformVertexShader
-			: public VertexShader
-		{
-			virtual void Execute(void const* attributeInput, void const* constantInput, void* attributeOutput) override
-			{
-				AttributeInputPackage const* input = static_cast<AttributeInputPackage const*>(attributeInput);
-				ConstantPackage const* constant = static_cast<ConstantPackage const*>(constantInput);
-				AttributeOutputPackage* output = static_cast<AttributeOutputPackage*>(attributeOutput);
-
-				f32V3 positionInView = Transform(input->vertex.position, constant->modelToViewMatrix);
-				f32V4 position = Transform(f32V4(input->vertex.position.X(), input->vertex.position.Y(), input->vertex.position.Z(), 1), constant->modelToClipMatrix);
-				f32V3 normalInView = TransformDirection(input->vertex.normal, constant->modelToViewMatrix);
-				*output = AttributeOutputPackage(Vertex(positionInView, normalInView, input->vertex.textureCoordinate), position);
-			}
-		};
-
 		struct AttributeWritingPixelShader
 			: public FragmentShader
 		{
@@ -105,6 +100,36 @@ namespace X
 
 		};
 
+		/*
+		*	Visible fragment of a pixel packed in 64 bits, the nearest fragment has the smallest value.
+		*	Depth in [0, 1] is in the high half, its bits are ordered the same as the values.
+		*	The triangle id is inverted in the low half, so on equal depth the later triangle wins as with the serial depth test.
+		*/
+		static const u64 EmptyVisibility = std::numeric_limits<u64>::max();
+
+		u64 PackVisibility(f32 z, u32 triangleID)
+		{
+			f32 depth = std::max(z, 0.f);
+			return (u64(reinterpret_cast<u32 const&>(depth)) << 32) | ~triangleID;
+		}
+		f32 UnpackDepth(u64 visibility)
+		{
+			u32 bits = u32(visibility >> 32);
+			return reinterpret_cast<f32 const&>(bits);
+		}
+		u32 UnpackTriangleID(u64 visibility)
+		{
+			return ~u32(visibility);
+		}
+
+		void AtomicMin(std::atomic<u64>& target, u64 value)
+		{
+			u64 old = target.load(std::memory_order_relaxed);
+			while (value < old && !target.compare_exchange_weak(old, value, std::memory_order_relaxed))
+			{
+			}
+		}
+
 		static const u32 TileSize = 16;
 
 		/*
@@ -120,18 +145,46 @@ namespace X
 				ConcreteTexture2D<GBufferElement>* gBuffer = shadingResource->gBuffer;
 				ConcreteTexture2D<f32V3>* colorBuffer = shadingResource->colorBuffer;
 
+				u32 xStart = TileSize * groupIndex.X();
+				u32 yStart = TileSize * groupIndex.Y();
+
+				if (constant->lightGrid != nullptr)
+				{
+					// lights are already assigned, every pixel takes those of its cluster
+					LightGrid const& lightGrid = *constant->lightGrid;
+					constant->pc->Begin(PerformanceCounter::Term::TiledShading);
+					for (u32 y = 0; y < TileSize; ++y)
+					{
+						for (u32 x = 0; x < TileSize; ++x)
+						{
+							Point<u32, 2> pixel(xStart + x, yStart + y);
+							GBufferElement const& input = gBuffer->GetValue(0, pixel);
+							f32V3 finalColor = f32V3(0, 0, 0);
+							// position of the pixels cleared is not written
+							if (input.material != nullptr)
+							{
+								u32 cluster = lightGrid.GetClusterIndex(pixel, input.position.Z());
+								finalColor = Shading(input, constant, lightGrid.GetClusterLights(cluster), lightGrid.GetClusterLightCount(cluster));
+							}
+							colorBuffer->SetValue(0, pixel, finalColor);
+						}
+					}
+					constant->pc->End(PerformanceCounter::Term::TiledShading);
+					return;
+				}
+
 				constant->pc->Begin(PerformanceCounter::Term::TiledFrustumCulling);
 
 				f32 minTileZ = std::numeric_limits<f32>::max();
 				f32 maxTileZ = 0;
-				u32 xStart = TileSize * groupIndex.X();
-				u32 yStart = TileSize * groupIndex.Y();
+				std::array<f32, TileSize * TileSize> tileZ;
 				
 				for (u32 y = 0; y < TileSize; ++y)
 				{
 					for (u32 x = 0; x < TileSize; ++x)
 					{
 						f32 z = gBuffer->GetValue(0, Point<u32, 2>(xStart + x, yStart + y)).position.Z();
+						tileZ[y * TileSize + x] = z;
 						if (z <= constant->far)
 						{
 							minTileZ = std::min(z, minTileZ);
@@ -140,46 +193,23 @@ namespace X
 					}
 				}
 
-				std::vector<u32> lightIndices;
-				lightIndices.reserve(16);
+				std::vector<u32>& lightIndices = (*shadingResource->tileLightIndices)[groupIndex.Y() * size.groupCount.X() + groupIndex.X()];
+				lightIndices.clear();
 
 				if (minTileZ <= maxTileZ)
 				{
-					// for details, see 'Deferred Rendering for Current and Future Rendering Pipelines' by Intel.
-					f32V2 tileScale = f32V2(f32(size.groupCount.X()), f32(size.groupCount.Y()));
-					f32V2 tileBias = tileScale - 2 * f32V2(f32(groupIndex.X()), f32(groupIndex.Y())) - f32V2(1, 1);
-					// NOTE: below are used by Intel but it's not the most tight frustum
-					//f32V2 tileScale = f32V2(f32(size.groupCount.X()), f32(size.groupCount.Y())) / 2;
-					//f32V2 tileBias = tileScale - f32V2(f32(groupIndex.X()), f32(groupIndex.Y()));
-
-					// projection matrix
-					// relevant matrix columns for this tile frusta
-					f32V3 c1 = f32V3(constant->projectionMatrix(0, 0) * tileScale.X(), 0.0f, tileBias.X());
-					f32V3 c2 = f32V3(0.0f, constant->projectionMatrix(1, 1) * tileScale.Y(), tileBias.Y());
-					f32V3 c4 = f32V3(0.0f, 0.0f, 1.0f);
-
-					// derive frustum planes
-					std::array<Plane, 6> frustumPlanes;
-					// right/left/bottom/top
-					frustumPlanes[0] = Plane(-Normalize(c4 - c1), 0);
-					frustumPlanes[1] = Plane(-Normalize(c4 + c1), 0);
-					frustumPlanes[2] = Plane(-Normalize(c4 - c2), 0);
-					frustumPlanes[3] = Plane(-Normalize(c4 + c2), 0);
-					// near/far
-					frustumPlanes[4] = Plane(f32V3(0.0f, 0.0f, -1.0f), minTileZ);
-					frustumPlanes[5] = Plane(f32V3(0.0f, 0.0f, 1.0f), -maxTileZ);
-
-					Frustum frustum(frustumPlanes);
-					
-					for (u32 i = 0; i < constant->pointLights.size(); ++i)
+					TileDepthMask depthMask(minTileZ, maxTileZ);
+					for (f32 z : tileZ)
 					{
-						PointLight* pointLight = constant->pointLights[i];
-						Sphere sphere = Sphere(constant->pointLightViewPositions[i], pointLight->GetRadius());
-						if (IntersectRough(frustum, sphere))
+						if (z <= constant->far)
 						{
-							lightIndices.push_back(i);
+							depthMask.Add(z);
 						}
 					}
+
+					Size<u32, 2> bufferSize(size.groupCount.X() * TileSize, size.groupCount.Y() * TileSize);
+					Frustum frustum = MakeTileFrustum(constant->projectionMatrix, bufferSize, Rectangle<u32>(xStart, yStart, TileSize, TileSize), minTileZ, maxTileZ);
+					constant->pointLightBVH->Query(frustum, &depthMask, &lightIndices);
 				}
 				constant->pc->End(PerformanceCounter::Term::TiledFrustumCulling);
 
@@ -190,7 +220,7 @@ namespace X
 					for (u32 x = 0; x < TileSize; ++x)
 					{
 						GBufferElement const& input = gBuffer->GetValue(0, Point<u32, 2>(xStart + x, yStart + y));
-						f32V3 finalColor = Shading(input, constant, lightIndices);
+						f32V3 finalColor = Shading(input, constant, lightIndices.data(), u32(lightIndices.size()));
 						colorBuffer->SetValue(0, Point<u32, 2>(xStart + x, yStart + y), finalColor);
 					}
 				}
@@ -198,7 +228,7 @@ namespace X
 
 			}
 
-			f32V3 Shading(GBufferElement const& input, SceneConstantPackage const* constant, std::vector<u32> const& pointLightIndices)
+			f32V3 Shading(GBufferElement const& input, SceneConstantPackage const* constant, u32 const* pointLightIndices, u32 pointLightCount)
 			{
 				f32V3 finalColor = f32V3(0, 0, 0);
 				if (input.material != nullptr)
@@ -214,15 +244,15 @@ namespace X
 					f32V3 surfaceNormal = Normalize(input.normal);
 
 					// point lights
-					for (u32 i = 0; i < pointLightIndices.size(); ++i)
+					PointLightTable const& pointLights = *constant->pointLights;
+					for (u32 k = 0; k < pointLightCount; ++k)
 					{
-						PointLight* light = constant->pointLights[pointLightIndices[i]];
-						f32V3 const& lightViewPosition = constant->pointLightViewPositions[pointLightIndices[i]];
-						f32V3 direction = light->GetLightDirection(lightViewPosition, input.position);
+						u32 i = pointLightIndices[k];
+						f32V3 direction = Normalize(pointLights.GetViewPosition(i) - input.position);
 						f32 dot = Dot(direction, surfaceNormal);
 						if (dot > 0)
 						{
-							f32V3 intensity = light->GetLightIntensity(lightViewPosition, input.position);
+							f32V3 intensity = pointLights.GetLightIntensity(i, input.position);
 							if (intensity.LengthSquared() >= 0.0001)
 							{
 								f32V3 half = Normalize(viewDirection + direction);
@@ -263,17 +293,34 @@ namespace X
 	struct DefferredPipeline::Impl
 	{
 		DefferredPipeline& pipeline_;
-		std::shared_ptr<VertexShader> vertexShader_;
 		std::shared_ptr<FragmentShader> fragmentShader_;
 		std::shared_ptr<ComputeShader> tiledShadingShader_;
 
 		std::unique_ptr<ConcreteTexture2D<GBufferElement>> gbuffer_;
 		std::unique_ptr<ConcreteTexture2D<f32>> depthBuffer_;
+		std::unique_ptr<HierarchicalZ> hierarchicalZ_;
 		std::unique_ptr<LineRasterizer> lineRasterizer_;
 		std::unique_ptr<FillRasterizer> fillRasterizer_;
-		std::vector<AttributeOutputPackage> attributeBuffer_;
-
-		RenderablePackCollector collector_;
+		std::unique_ptr<TileBinner> binner_;
+		std::unique_ptr<TriangleCuller> culler_;
+
+		typedef DrawCollector<ConstantPackage>::Draw Draw;
+		std::vector<Draw> draws_; // storage reused between frames
+		u32 drawCount_;
+		VertexStatistics vertexStatistics_; // sum of the draws of the last frame
+		TriangleStatistics triangleStatistics_; // sum of the draws of the last frame
+
+		DefferredPipeline::GeometryPassMode geometryPassMode_;
+		DefferredPipeline::LightCullingMode lightCullingMode_;
+		std::unique_ptr<LightBVH> lightBVH_;
+		PointLightTable pointLightTable_; // storage reused between frames
+		std::unique_ptr<LightGrid> lightGrid_;
+		std::vector<std::vector<u32>> tileLightIndices_; // of the tiled mode, one per shading tile
+		// used in AtomicDepth mode
+		std::unique_ptr<std::atomic<u64>[]> visibilityBuffer_;
+		std::vector<u32> drawTriangleOffsets_; // first triangle id of every draw, only visible triangles of fill draws have ids
+
+		DrawCollector<ConstantPackage> drawCollector_;
 
 		//ThreadedTaskPool pool_;
 		PerformanceCounter& performanceCounter_;
@@ -284,109 +331,330 @@ namespace X
 		{
 			gbuffer_ = std::make_unique<ConcreteTexture2D<GBufferElement>>(pipeline.GetBufferSize());
 			depthBuffer_ = std::make_unique<ConcreteTexture2D<f32>>(pipeline.GetBufferSize());
+			hierarchicalZ_ = std::make_unique<HierarchicalZ>(pipeline.GetBufferSize());
 
 			lineRasterizer_ = std::make_unique<LineRasterizer>();
-			fillRasterizer_ = std::make_unique<FillRasterizer>();
+			fillRasterizer_ = std::make_unique<FillRasterizer>(FillRasterizer::Mode::Hierarchical);
+			fillRasterizer_->SetHierarchicalZ(hierarchicalZ_.get());
+			binner_ = std::make_unique<TileBinner>(pipeline.GetBufferSize());
+			culler_ = std::make_unique<TriangleCuller>(pipeline.GetBufferSize());
+			drawCount_ = 0;
+			vertexStatistics_ = VertexStatistics();
+			triangleStatistics_ = TriangleStatistics();
+			geometryPassMode_ = DefferredPipeline::GeometryPassMode::TileBinned;
+			lightCullingMode_ = DefferredPipeline::LightCullingMode::Clustered;
+			lightBVH_ = std::make_unique<LightBVH>();
+			lightGrid_ = std::make_unique<LightGrid>(pipeline.GetBufferSize());
+			tileLightIndices_.resize((pipeline.GetBufferSize().X() / TileSize) * (pipeline.GetBufferSize().Y() / TileSize));
+			visibilityBuffer_ = std::make_unique<std::atomic<u64>[]>(pipeline.GetBufferSize().X() * pipeline.GetBufferSize().Y());
 
-			vertexShader_ = std::make_shared<TransformVertexShader>();
 			fragmentShader_ = std::make_shared<AttributeWritingPixelShader>();
 			tiledShadingShader_ = std::make_shared<TiledShadingShader>();
 		}
 
-		void GeometryPass(std::shared_ptr<Entity> const& entity, f32M44 const& viewProjectionMatrix, f32M44 const& viewMatrix, Frustum const& frustum)
+		struct GBufferContinuation
 		{
-			Renderable* renderable = entity->GetComponent<Renderable>();
-			if (renderable != nullptr && renderable->IsActive())
+			Impl& impl;
+			ConstantPackage const& constant;
+			GBufferContinuation(Impl& impl, ConstantPackage const* constant)
+				: impl(impl), constant(*constant)
+			{
+			}
+			void operator() (AttributeOutputPackage const& fragmentInput, Point<u32, 2> sceenCoordinate) const
 			{
-				Transformation* transformation = entity->GetComponent<Transformation>();
-				f32M44 worldMatrix = transformation->GetWorldMatrix();
-				f32M44 worldViewMatrix = worldMatrix * viewMatrix;
-				RotatedBoundingBox box = Transform(renderable->GetBoundingBox(), worldViewMatrix);
-				if (!IntersectRough(box, frustum))
+				GBufferElement element;
+				(*impl.fragmentShader_)(&fragmentInput, &constant, &element);
+				impl.gbuffer_->SetValue(0, sceenCoordinate, element);
+			}
+			void operator() (FragmentPacket const& packet, u32 activeMask) const
+			{
+				ForEachActiveFragment(packet, activeMask, *this);
+			}
+		};
+
+		struct VisibilityContinuation
+		{
+			std::atomic<u64>* visibilityBuffer;
+			u32 width;
+			u32 triangleID;
+			VisibilityContinuation(std::atomic<u64>* visibilityBuffer, u32 width, u32 triangleID)
+				: visibilityBuffer(visibilityBuffer), width(width), triangleID(triangleID)
+			{
+			}
+			void operator() (AttributeOutputPackage const& fragmentInput, Point<u32, 2> sceenCoordinate) const
+			{
+				AtomicMin(visibilityBuffer[sceenCoordinate.Y() * width + sceenCoordinate.X()], PackVisibility(fragmentInput.position.Z(), triangleID));
+			}
+			void operator() (FragmentPacket const& packet, u32 activeMask) const
+			{
+				ForEachActiveFragment(packet, activeMask, *this);
+			}
+		};
+
+		void ProcessGeometry(Draw& draw)
+		{
+			IndexData const& indices = draw.GetIndices();
+			assert(indices.GetCount() % 3 == 0);
+			VertexBuffer const& vertices = *draw.layout->GetVertexBuffer();
+			u32 vertexCount = vertices.GetCount();
+			u32 instanceCount = draw.GetInstanceCount();
+			if (draw.attributeBuffer.size() < vertexCount * instanceCount)
+			{
+				draw.attributeBuffer.resize(vertexCount * instanceCount);
+			}
+
+			bool fill = draw.material->GetRasterizeMode() == Material::RasterizeMode::Fill;
+			bool tileBinned = geometryPassMode_ == DefferredPipeline::GeometryPassMode::TileBinned;
+			// instances are always batched
+			if (pipeline_.GetVertexProcessingMode() == Pipeline::VertexProcessingMode::PostTransformCache && fill && draw.instances.empty())
+			{
+				// culling needs only positions, then only vertices of the visible triangles are shaded
+				if (draw.positionBuffer.size() < vertexCount)
 				{
-					return;
+					draw.positionBuffer.resize(vertexCount);
 				}
-				renderable->GetRenderablePackage(collector_, frustum, worldMatrix * viewMatrix);
-
-				for (auto& renderablePackage : collector_.GetAllPackages())
+				TransformPositions(vertices, draw.constant.modelToClipMatrix, draw.positionBuffer.data());
+				culler_->Cull(draw.positionBuffer, indices, 1, vertexCount, fillRasterizer_->GetGuardBand(), &draw.visible);
+				if (tileBinned)
 				{
-					ConstantPackage constant;
-					constant.material = renderablePackage.material.get();
-					constant.modelToClipMatrix = worldMatrix * viewProjectionMatrix;
-					constant.modelToViewMatrix = worldMatrix * viewMatrix;
+					binner_->Bin(draw.positionBuffer, indices, vertexCount, draw.visible, &draw.bins);
+				}
 
+				// vertex shading
+				TransformVisibleVertices(vertices, indices, draw.visible.triangles, draw.constant.modelToViewMatrix, draw.constant.modelToClipMatrix,
+					draw.attributeBuffer.data(), &draw.vertexMarks, &draw.vertexStatistics);
+				return;
+			}
 
-					std::vector<u16> const& indices = renderablePackage.layout->GetIndexBuffer()->GetData();
-					assert(indices.size() % 3 == 0);
-					std::vector<Vertex> const& vertices = renderablePackage.layout->GetVertexBuffer()->GetData();
-					if (attributeBuffer_.size() < vertices.size())
-					{
-						attributeBuffer_.resize(vertices.size());
-					}
+			// vertex shading
+			for (u32 i = 0; i < instanceCount; ++i)
+			{
+				TransformVertices(vertices, draw.GetModelToViewMatrix(i), draw.GetModelToClipMatrix(i), draw.attributeBuffer.data() + i * vertexCount);
+			}
+			draw.vertexStatistics.vertexCount = vertexCount * instanceCount;
+			draw.vertexStatistics.uniqueVertexCount = vertexCount * instanceCount;
+			draw.vertexStatistics.shadedVertexCount = vertexCount * instanceCount;
 
-					Material::RasterizeMode mode = renderablePackage.material->GetRasterizeMode();
+			if (fill)
+			{
+				culler_->Cull(draw.attributeBuffer, indices, instanceCount, vertexCount, fillRasterizer_->GetGuardBand(), &draw.visible);
+				if (tileBinned)
+				{
+					binner_->Bin(draw.attributeBuffer, indices, vertexCount, draw.visible, &draw.bins);
+				}
+			}
+			else
+			{
+				draw.visible.statistics = TriangleStatistics();
+			}
+		}
 
-					// vertex shading
-					performanceCounter_.Begin(PerformanceCounter::Term::DeferredVertex);
-					for (u32 i = 0; i < vertices.size(); ++i)
+		void RasterizeTile(u32 tileIndex)
+		{
+			Rectangle<u32> tile = binner_->GetTileRectangle(tileIndex);
+			for (u32 i = 0; i < drawCount_; ++i)
+			{
+				Draw& draw = draws_[i];
+				if (draw.material->GetRasterizeMode() != Material::RasterizeMode::Fill)
+				{
+					continue;
+				}
+				draw.GetIndices().Visit([&] (auto const& indices)
+				{
+					GBufferContinuation continuation(*this, &draw.constant);
+					for (u32 k = draw.bins.tileOffsets[tileIndex]; k < draw.bins.tileOffsets[tileIndex + 1]; ++k)
 					{
-						(*vertexShader_)(&AttributeInputPackage(vertices[i]), &constant, &attributeBuffer_[i]);
+						u32 visibleIndex = draw.bins.triangles[k];
+						std::array<u32, 3> corners = draw.GetTriangleVertices(indices, draw.visible.triangles[visibleIndex]);
+						AttributeOutputPackage& v0 = draw.attributeBuffer[corners[0]];
+						AttributeOutputPackage& v1 = draw.attributeBuffer[corners[1]];
+						AttributeOutputPackage& v2 = draw.attributeBuffer[corners[2]];
+						fillRasterizer_->RasterizeCulled(pipeline_.GetBufferSize(), *depthBuffer_, continuation, Triangle(v0, v1, v2), tile,
+							draw.visible.clipping[visibleIndex] != 0);
 					}
+				});
+			}
+		}
 
-					performanceCounter_.End(PerformanceCounter::Term::DeferredVertex);
+		// draw of a triangle id, the last one beginning at or before it
+		u32 FindDraw(u32 triangleID) const
+		{
+			auto end = drawTriangleOffsets_.begin() + drawCount_ + 1;
+			return u32(std::upper_bound(drawTriangleOffsets_.begin(), end, triangleID) - drawTriangleOffsets_.begin()) - 1;
+		}
 
-					auto continuation = [this, &constant] (AttributeOutputPackage const& fragmentInput, Point<u32, 2> sceenCoordinate)
-					{
-						GBufferElement element;
-						(*fragmentShader_)(&fragmentInput, &constant, &element);
-						gbuffer_->SetValue(0, sceenCoordinate, element);
-					};
-					// rasterize
-					switch (mode)
-					{
-					case Material::RasterizeMode::Line:
-						for (u32 i = 0; i < indices.size(); i += 3)
-						{
-							AttributeOutputPackage& v0 = attributeBuffer_[indices[i + 0]];
-							AttributeOutputPackage& v1 = attributeBuffer_[indices[i + 1]];
-							AttributeOutputPackage& v2 = attributeBuffer_[indices[i + 2]];
-							lineRasterizer_->Rasterize(pipeline_.GetBufferSize(), *depthBuffer_, continuation, Triangle(v0, v1, v2));
-						}
-						break;
-					case Material::RasterizeMode::Fill:
-						performanceCounter_.Begin(PerformanceCounter::Term::DeferredRasterizeAndPixel);
-						if (context_.GetThreadSupport() == 1)
-						{
-							for (u32 i = 0; i < indices.size(); i += 3)
-							{
-								AttributeOutputPackage& v0 = attributeBuffer_[indices[i + 0]];
-								AttributeOutputPackage& v1 = attributeBuffer_[indices[i + 1]];
-								AttributeOutputPackage& v2 = attributeBuffer_[indices[i + 2]];
-								Triangle triangle(v0, v1, v2);
+		void RasterizeTriangle(u32 triangleID)
+		{
+			u32 drawIndex = FindDraw(triangleID);
+			Draw& draw = draws_[drawIndex];
+			u32 visibleIndex = triangleID - drawTriangleOffsets_[drawIndex];
+			u32 triangleIndex = draw.visible.triangles[visibleIndex];
+			draw.GetIndices().Visit([&] (auto const& indices)
+			{
+				std::array<u32, 3> corners = draw.GetTriangleVertices(indices, triangleIndex);
+				AttributeOutputPackage& v0 = draw.attributeBuffer[corners[0]];
+				AttributeOutputPackage& v1 = draw.attributeBuffer[corners[1]];
+				AttributeOutputPackage& v2 = draw.attributeBuffer[corners[2]];
+				VisibilityContinuation continuation(visibilityBuffer_.get(), pipeline_.GetBufferSize().X(), triangleID);
+				Size<u32, 2> size = pipeline_.GetBufferSize();
+				fillRasterizer_->RasterizeCulled(size, *depthBuffer_, continuation, Triangle(v0, v1, v2), Rectangle<u32>(0, 0, size.X(), size.Y()),
+					draw.visible.clipping[visibleIndex] != 0);
+			});
+		}
 
-								fillRasterizer_->Rasterize(pipeline_.GetBufferSize(), *depthBuffer_, continuation, triangle);
-							}
-						}
-						else
-						{
-							concurrency::parallel_for(0u, indices.size() / 3, [this, &indices, &continuation] (u32 index)
-							{
-								AttributeOutputPackage& v0 = attributeBuffer_[indices[index * 3 + 0]];
-								AttributeOutputPackage& v1 = attributeBuffer_[indices[index * 3 + 1]];
-								AttributeOutputPackage& v2 = attributeBuffer_[indices[index * 3 + 2]];
-								Triangle triangle(v0, v1, v2);
-								fillRasterizer_->Rasterize(pipeline_.GetBufferSize(), *depthBuffer_, continuation, triangle);
-							});
-						}
-						performanceCounter_.End(PerformanceCounter::Term::DeferredRasterizeAndPixel);
-						break;
-					default:
-						assert(false);
-						break;
-					}
-					//taskGroup_.wait();
+		/*
+		*	Interpolate the visible triangle at the pixel centers of row y and write the gbuffer.
+		*	Attributes are weighted by the perspective correct barycentrics of the pixel ray against the clip space triangle.
+		*/
+		void ResolveRow(u32 y)
+		{
+			Size<u32, 2> size = pipeline_.GetBufferSize();
+			for (u32 x = 0; x < size.X(); ++x)
+			{
+				u64 visibility = visibilityBuffer_[y * size.X() + x].load(std::memory_order_relaxed);
+				if (visibility == EmptyVisibility)
+				{
+					continue;
+				}
+				u32 triangleID = UnpackTriangleID(visibility);
+				u32 drawIndex = FindDraw(triangleID);
+				Draw& draw = draws_[drawIndex];
+				u32 triangleIndex = draw.visible.triangles[triangleID - drawTriangleOffsets_[drawIndex]];
+				draw.GetIndices().Visit([&] (auto const& indices)
+				{
+					std::array<u32, 3> corners = draw.GetTriangleVertices(indices, triangleIndex);
+					AttributeOutputPackage const& v0 = draw.attributeBuffer[corners[0]];
+					AttributeOutputPackage const& v1 = draw.attributeBuffer[corners[1]];
+					AttributeOutputPackage const& v2 = draw.attributeBuffer[corners[2]];
+
+					f32V3 pixel((x + 0.5f) / size.X() * 2 - 1, (y + 0.5f) / size.Y() * 2 - 1, 1);
+					f32V3 c0(v0.position.X(), v0.position.Y(), v0.position.W());
+					f32V3 c1(v1.position.X(), v1.position.Y(), v1.position.W());
+					f32V3 c2(v2.position.X(), v2.position.Y(), v2.position.W());
+					f32 b0 = Dot(pixel, Cross(c1, c2));
+					f32 b1 = Dot(pixel, Cross(c2, c0));
+					f32 b2 = Dot(pixel, Cross(c0, c1));
+					f32 inverseSum = 1 / (b0 + b1 + b2);
+					b0 *= inverseSum;
+					b1 *= inverseSum;
+					b2 *= inverseSum;
+					f32 w = b0 * c0.Z() + b1 * c1.Z() + b2 * c2.Z();
+
+					AttributeOutputPackage fragmentInput(Lerp3(v0.vertex, v1.vertex, v2.vertex, b0, b1, b2), f32V4(x + 0.5f, y + 0.5f, UnpackDepth(visibility), 1 / w));
+					GBufferContinuation(*this, &draw.constant)(fragmentInput, Point<u32, 2>(x, y));
+				});
+			}
+		}
+
+		// triangles of all draws in parallel, the nearest fragment of each pixel wins by an atomic min on the visibility buffer
+		void RasterizeAtomicDepth()
+		{
+			drawTriangleOffsets_.resize(drawCount_ + 1);
+			drawTriangleOffsets_[0] = 0;
+			for (u32 i = 0; i < drawCount_; ++i)
+			{
+				Draw& draw = draws_[i];
+				u32 triangleCount = draw.material->GetRasterizeMode() == Material::RasterizeMode::Fill ? u32(draw.visible.triangles.size()) : 0;
+				drawTriangleOffsets_[i + 1] = drawTriangleOffsets_[i] + triangleCount;
+			}
+			u32 triangleCount = drawTriangleOffsets_[drawCount_];
+			u32 pixelCount = pipeline_.GetBufferSize().X() * pipeline_.GetBufferSize().Y();
+			for (u32 i = 0; i < pixelCount; ++i)
+			{
+				visibilityBuffer_[i].store(EmptyVisibility, std::memory_order_relaxed);
+			}
+
+			if (context_.GetThreadSupport() == 1)
+			{
+				for (u32 i = 0; i < triangleCount; ++i)
+				{
+					RasterizeTriangle(i);
+				}
+				for (u32 y = 0; y < pipeline_.GetBufferSize().Y(); ++y)
+				{
+					ResolveRow(y);
+				}
+			}
+			else
+			{
+				concurrency::parallel_for(0u, triangleCount, [this] (u32 triangleID)
+				{
+					RasterizeTriangle(triangleID);
+				});
+				concurrency::parallel_for(0u, pipeline_.GetBufferSize().Y(), [this] (u32 y)
+				{
+					ResolveRow(y);
+				});
+			}
+		}
+
+		// collect draws, vertex shading and binning, then rasterize tiles in parallel
+		void GeometryPass(std::vector<std::shared_ptr<Entity>> const& entities, f32M44 const& viewProjectionMatrix, f32M44 const& viewMatrix, Frustum const& frustum, f32 pixelScale)
+		{
+			drawCount_ = drawCollector_.Collect(entities, viewProjectionMatrix, viewMatrix, frustum, pixelScale, ConstantPackage(), context_.GetThreadSupport(), &draws_);
+			fillRasterizer_->SetAtomicDepth(geometryPassMode_ == DefferredPipeline::GeometryPassMode::AtomicDepth);
+
+			performanceCounter_.Begin(PerformanceCounter::Term::DeferredVertex);
+			if (context_.GetThreadSupport() == 1)
+			{
+				for (u32 i = 0; i < drawCount_; ++i)
+				{
+					ProcessGeometry(draws_[i]);
+				}
+			}
+			else
+			{
+				concurrency::parallel_for(0u, drawCount_, [this] (u32 index)
+				{
+					ProcessGeometry(draws_[index]);
+				});
+			}
+			vertexStatistics_ = SumVertexStatistics(draws_, drawCount_);
+			triangleStatistics_ = SumTriangleStatistics(draws_, drawCount_);
+			performanceCounter_.End(PerformanceCounter::Term::DeferredVertex);
+
+			performanceCounter_.Begin(PerformanceCounter::Term::DeferredRasterizeAndPixel);
+			if (geometryPassMode_ == DefferredPipeline::GeometryPassMode::AtomicDepth)
+			{
+				RasterizeAtomicDepth();
+			}
+			else if (context_.GetThreadSupport() == 1)
+			{
+				for (u32 i = 0; i < binner_->GetTileCount(); ++i)
+				{
+					RasterizeTile(i);
 				}
-				collector_.Clear();
+			}
+			else
+			{
+				// every tile is owned by one worker, draws in a tile are in submission order
+				concurrency::parallel_for(0u, binner_->GetTileCount(), [this] (u32 tileIndex)
+				{
+					RasterizeTile(tileIndex);
+				});
+			}
+			performanceCounter_.End(PerformanceCounter::Term::DeferredRasterizeAndPixel);
+
+			// line mode is for debugging, not binned
+			for (u32 i = 0; i < drawCount_; ++i)
+			{
+				Draw& draw = draws_[i];
+				if (draw.material->GetRasterizeMode() != Material::RasterizeMode::Line)
+				{
+					continue;
+				}
+				draw.GetIndices().Visit([&] (auto const& indices)
+				{
+					GBufferContinuation continuation(*this, &draw.constant);
+					for (u32 k = 0; k < draw.GetTriangleCount(); ++k)
+					{
+						std::array<u32, 3> corners = draw.GetTriangleVertices(indices, k);
+						AttributeOutputPackage& v0 = draw.attributeBuffer[corners[0]];
+						AttributeOutputPackage& v1 = draw.attributeBuffer[corners[1]];
+						AttributeOutputPackage& v2 = draw.attributeBuffer[corners[2]];
+						lineRasterizer_->Rasterize(pipeline_.GetBufferSize(), *depthBuffer_, continuation, Triangle(v0, v1, v2));
+					}
+				});
 			}
 		}
 	};
@@ -402,6 +670,47 @@ namespace X
 	{
 	}
 
+	void DefferredPipeline::SetGeometryPassMode(GeometryPassMode mode)
+	{
+		impl_->geometryPassMode_ = mode;
+	}
+
+	DefferredPipeline::GeometryPassMode DefferredPipeline::GetGeometryPassMode() const
+	{
+		return impl_->geometryPassMode_;
+	}
+
+	void DefferredPipeline::SetLightCullingMode(LightCullingMode mode)
+	{
+		impl_->lightCullingMode_ = mode;
+	}
+
+	DefferredPipeline::LightCullingMode DefferredPipeline::GetLightCullingMode() const
+	{
+		return impl_->lightCullingMode_;
+	}
+
+	VertexStatistics DefferredPipeline::GetVertexStatistics() const
+	{
+		return impl_->vertexStatistics_;
+	}
+
+	TriangleStatistics DefferredPipeline::GetTriangleStatistics() const
+	{
+		return impl_->triangleStatistics_;
+	}
+
+	RasterizerStatistics DefferredPipeline::GetRasterizerStatistics() const
+	{
+		FillRasterizer::BlockStatistics blockStatistics = impl_->fillRasterizer_->GetBlockStatistics();
+		RasterizerStatistics statistics;
+		statistics.acceptedBlockCount = blockStatistics.accepted;
+		statistics.rejectedBlockCount = blockStatistics.rejected;
+		statistics.splitBlockCount = blockStatistics.split;
+		statistics.occludedBlockCount = blockStatistics.occluded;
+		return statistics;
+	}
+
 
 
 
@@ -426,6 +735,8 @@ namespace X
 		gBufferClearValue.textureCoordinate = f32V2(0, 0);
 		impl_->gbuffer_->Clear(0, gBufferClearValue);
 		impl_->depthBuffer_->Clear(0, 1.f);
+		impl_->hierarchicalZ_->Clear(1.f);
+		impl_->fillRasterizer_->ClearBlockStatistics();
 
 		SceneConstantPackage sceneConstant;
 
@@ -433,8 +744,8 @@ namespace X
 		sceneConstant.ambientLight = nullptr;
 		sceneConstant.directionalLight = nullptr;
 		sceneConstant.directionalLightViewDirection = f32V3(0, 0, 0);
-		sceneConstant.pointLights.clear();
-		sceneConstant.pointLightViewPositions.clear();
+		std::vector<PointLight*> pointLights;
+		std::vector<f32V3> pointLightPositions;
 
 
 		f32M44 viewMatrix = camera->GetComponent<Camera>()->GetViewMatrix();
@@ -443,8 +754,10 @@ namespace X
 
 		sceneConstant.projectionMatrix = projectionMatrix;
 		sceneConstant.far = CheckedCast<PerspectiveCamera*>(camera->GetComponent<Camera>())->GetFar();
+		sceneConstant.lightGrid = nullptr;
 
 		Frustum const& frustum = camera->GetComponent<Camera>()->GetFrustum();
+		f32 pixelScale = GetPixelScale(projectionMatrix, GetBufferSize());
 
 		impl_->performanceCounter_.Begin(PerformanceCounter::Term::DeferredLightTransform);
 		for (auto& entity : entities)
@@ -468,10 +781,8 @@ namespace X
 				}
 				else if (PointLight* pointLight = dynamic_cast<PointLight*>(light))
 				{
-					sceneConstant.pointLights.push_back(pointLight);
-					f32V3 lightPosition = pointLight->GetOwner()->GetComponent<Transformation>()->GetPosition();
-					f32V3 lightViewPosition = Transform(lightPosition, viewMatrix);
-					sceneConstant.pointLightViewPositions.push_back(lightViewPosition);
+					pointLights.push_back(pointLight);
+					pointLightPositions.push_back(pointLight->GetOwner()->GetComponent<Transformation>()->GetPosition());
 				}
 				else
 				{
@@ -479,23 +790,25 @@ namespace X
 				}
 			}
 		}
+		MakePointLightTable(pointLights, pointLightPositions, viewMatrix, &impl_->pointLightTable_);
+		sceneConstant.pointLights = &impl_->pointLightTable_;
 		impl_->performanceCounter_.End(PerformanceCounter::Term::DeferredLightTransform);
 
-		impl_->performanceCounter_.Begin(PerformanceCounter::Term::DeferredGeometryPass);
-		if (impl_->context_.GetThreadSupport() == 1)
-		{
-			std::for_each(entities.begin(), entities.end(), [this, &viewMatrix, &viewProjectionMatrix, &frustum] (std::shared_ptr<Entity> const& entity)
-			{
-				impl_->GeometryPass(entity, viewProjectionMatrix, viewMatrix, frustum);
-			});
-		}
-		else
+		impl_->performanceCounter_.Begin(PerformanceCounter::Term::LightBVHBuild);
+		impl_->lightBVH_->Build(impl_->pointLightTable_.spheres, impl_->context_.GetThreadSupport());
+		impl_->performanceCounter_.End(PerformanceCounter::Term::LightBVHBuild);
+		sceneConstant.pointLightBVH = impl_->lightBVH_.get();
+
+		if (impl_->lightCullingMode_ == LightCullingMode::Clustered)
 		{
-			concurrency::parallel_for_each(entities.begin(), entities.end(), [this, &viewMatrix, &viewProjectionMatrix, &frustum] (std::shared_ptr<Entity> const& entity)
-			{
-				impl_->GeometryPass(entity, viewProjectionMatrix, viewMatrix, frustum);
-			});
+			impl_->performanceCounter_.Begin(PerformanceCounter::Term::ClusteredLightAssignment);
+			impl_->lightGrid_->Build(projectionMatrix, impl_->pointLightTable_.spheres, *impl_->lightBVH_, impl_->context_.GetThreadSupport());
+			impl_->performanceCounter_.End(PerformanceCounter::Term::ClusteredLightAssignment);
+			sceneConstant.lightGrid = impl_->lightGrid_.get();
 		}
+
+		impl_->performanceCounter_.Begin(PerformanceCounter::Term::DeferredGeometryPass);
+		impl_->GeometryPass(entities, viewProjectionMatrix, viewMatrix, frustum, pixelScale);
 		impl_->performanceCounter_.End(PerformanceCounter::Term::DeferredGeometryPass);
 
 
@@ -503,6 +816,7 @@ namespace X
 		ShadingResource shadingResource;
 		shadingResource.colorBuffer = &GetRenderer().GetColorBuffer();
 		shadingResource.gBuffer = impl_->gbuffer_.get();
+		shadingResource.tileLightIndices = &impl_->tileLightIndices_;
 		ComputeLauncher l(impl_->tiledShadingShader_, &sceneConstant, &shadingResource);
 		ComputeShader::WorkSize workSize(Size<u32, 3>(GetBufferSize().X() / TileSize, GetBufferSize().Y() / TileSize, 1), Size<u32, 3>(1, 1, 1));
 		l.Launch(workSize, impl_->context_.GetThreadSupport());
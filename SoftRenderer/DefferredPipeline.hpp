@@ -9,12 +9,34 @@ namespace X
 	class DefferredPipeline
 		: public Pipeline
 	{
+	public:
+		enum class GeometryPassMode
+		{
+			TileBinned, // triangles binned to screen tiles, every tile rasterized by one thread
+			AtomicDepth, // triangles rasterized in parallel with atomic depth into a visibility buffer, then resolved per pixel
+		};
+		enum class LightCullingMode
+		{
+			Tiled, // point lights culled per screen tile against its depth range, inside the shading pass
+			Clustered, // point lights assigned to a light grid of screen tiles and depth slices before the shading pass
+		};
+
 	public:
 		DefferredPipeline(Renderer& renderer, Size<u32, 2> const& bufferSize);
 		virtual ~DefferredPipeline() override;
 
 		virtual void RenderScene(f64 current, f32 delta) override;
 
+		void SetGeometryPassMode(GeometryPassMode mode);
+		GeometryPassMode GetGeometryPassMode() const;
+
+		void SetLightCullingMode(LightCullingMode mode);
+		LightCullingMode GetLightCullingMode() const;
+
+		virtual RasterizerStatistics GetRasterizerStatistics() const override;
+		virtual VertexStatistics GetVertexStatistics() const override;
+		virtual TriangleStatistics GetTriangleStatistics() const override;
+
 
 	private:
 		struct Impl;
@@ -0,0 +1,228 @@
+#pragma once
+#include "Common.hpp"
+#include "PipelineDetail.hpp"
+#include "Pipeline.hpp"
+#include "TriangleCuller.hpp"
+#include "TileBinner.hpp"
+#include "Renderable.hpp"
+#include "GeometryLayout.hpp"
+#include "Entity.hpp"
+
+#include <ppl.h>
+
+namespace X
+{
+	/*
+	*	Vertical scale of the projection to pixels, pixels covered by a view space length of 1 at distance 1.
+	*/
+	inline f32 GetPixelScale(f32M44 const& projectionMatrix, Size<u32, 2> const& bufferSize)
+	{
+		return projectionMatrix[5] * bufferSize.Y() / 2;
+	}
+
+	/*
+	*	One renderable package of the frame with its post-transform vertices, visible triangles and tile bins.
+	*	ConstantT is the constant package of the pipeline, with at least material, modelToClipMatrix and modelToViewMatrix.
+	*/
+	template <typename ConstantT>
+	struct PipelineDraw
+	{
+		std::shared_ptr<GeometryLayout> layout;
+		std::shared_ptr<Material> material;
+		IndexData indices; // of the meshlets not culled, empty if the whole index buffer is drawn
+		std::vector<f32M44> instances; // model matrices of the visible instances, applied before the matrices of constant, empty if not instanced
+		ConstantT constant;
+		std::vector<f32V4> positionBuffer; // of the passes culling before vertex shading, instance after instance
+		std::vector<AttributeOutputPackage> attributeBuffer; // instance after instance
+		VisibleTriangles visible;
+		TileBins bins;
+		std::vector<u8> vertexMarks; // of the post-transform cache mode
+		VertexStatistics vertexStatistics;
+
+		IndexData const& GetIndices() const
+		{
+			return indices.IsEmpty() ? layout->GetIndexBuffer()->GetData() : indices;
+		}
+
+		u32 GetInstanceCount() const
+		{
+			return instances.empty() ? 1 : u32(instances.size());
+		}
+		u32 GetTriangleCount() const
+		{
+			return GetIndices().GetCount() / 3 * GetInstanceCount();
+		}
+		f32M44 GetModelToClipMatrix(u32 instance) const
+		{
+			return instances.empty() ? constant.modelToClipMatrix : instances[instance] * constant.modelToClipMatrix;
+		}
+		f32M44 GetModelToViewMatrix(u32 instance) const
+		{
+			return instances.empty() ? constant.modelToViewMatrix : instances[instance] * constant.modelToViewMatrix;
+		}
+
+		/*
+		*	Post-transform vertices of a triangle. Instance n takes triangles [n * triangleCount, (n + 1) * triangleCount)
+		*	and vertices [n * vertexCount, (n + 1) * vertexCount) of the buffers.
+		*/
+		template <typename IndexT>
+		std::array<u32, 3> GetTriangleVertices(std::vector<IndexT> const& indices, u32 triangleIndex) const
+		{
+			u32 base = 0;
+			if (!instances.empty())
+			{
+				u32 triangleCount = u32(indices.size() / 3);
+				u32 instance = triangleIndex / triangleCount;
+				triangleIndex -= instance * triangleCount;
+				base = instance * layout->GetVertexBuffer()->GetCount();
+			}
+			return { { base + indices[triangleIndex * 3 + 0], base + indices[triangleIndex * 3 + 1], base + indices[triangleIndex * 3 + 2] } };
+		}
+	};
+
+	template <typename ConstantT>
+	VertexStatistics SumVertexStatistics(std::vector<PipelineDraw<ConstantT>> const& draws, u32 drawCount)
+	{
+		VertexStatistics sum = VertexStatistics();
+		for (u32 i = 0; i < drawCount; ++i)
+		{
+			sum.vertexCount += draws[i].vertexStatistics.vertexCount;
+			sum.uniqueVertexCount += draws[i].vertexStatistics.uniqueVertexCount;
+			sum.shadedVertexCount += draws[i].vertexStatistics.shadedVertexCount;
+			sum.triangleCount += draws[i].GetTriangleCount();
+		}
+		return sum;
+	}
+
+	template <typename ConstantT>
+	TriangleStatistics SumTriangleStatistics(std::vector<PipelineDraw<ConstantT>> const& draws, u32 drawCount)
+	{
+		TriangleStatistics sum = TriangleStatistics();
+		for (u32 i = 0; i < drawCount; ++i)
+		{
+			TriangleStatistics const& statistics = draws[i].visible.statistics;
+			sum.outsideCount += statistics.outsideCount;
+			sum.zeroAreaCount += statistics.zeroAreaCount;
+			sum.backFacingCount += statistics.backFacingCount;
+			sum.subPixelCount += statistics.subPixelCount;
+			sum.acceptedCount += statistics.acceptedCount;
+		}
+		return sum;
+	}
+
+	/*
+	*	Entity parallel draw collection of both pipelines.
+	*/
+	template <typename ConstantT>
+	class DrawCollector
+		: Noncopyable
+	{
+	public:
+		typedef PipelineDraw<ConstantT> Draw;
+
+	public:
+		/*
+		*	Entities are split into one contiguous range per worker, each worker culls and collects into its own context.
+		*	Contexts are concatenated in worker order, so draws stay in entity order.
+		*	@sharedConstant: copied to the constant of every draw before its material and matrices are set.
+		*	@draws: storage reused between frames, only layout, indices, instances, material and constant are set.
+		*	@return: number of draws collected, the first of draws.
+		*/
+		u32 Collect(std::vector<std::shared_ptr<Entity>> const& entities, f32M44 const& viewProjectionMatrix, f32M44 const& viewMatrix, Frustum const& frustum, f32 pixelScale,
+			ConstantT const& sharedConstant, u32 threadSupport, std::vector<Draw>* draws)
+		{
+			u32 workerCount = threadSupport == 1 ? 1 : concurrency::CurrentScheduler::GetNumberOfVirtualProcessors();
+			while (collectContexts_.size() < workerCount)
+			{
+				collectContexts_.push_back(std::make_unique<CollectContext>());
+			}
+			u32 entityCount = u32(entities.size());
+			auto collect = [&] (u32 worker)
+			{
+				CollectContext& collectContext = *collectContexts_[worker];
+				collectContext.draws.clear();
+				for (u32 i = entityCount * worker / workerCount; i < entityCount * (worker + 1) / workerCount; ++i)
+				{
+					CollectEntity(entities[i], viewProjectionMatrix, viewMatrix, frustum, pixelScale, sharedConstant, collectContext);
+				}
+			};
+			if (workerCount == 1)
+			{
+				collect(0);
+			}
+			else
+			{
+				concurrency::parallel_for(0u, workerCount, collect);
+			}
+
+			u32 drawCount = 0;
+			for (u32 worker = 0; worker < workerCount; ++worker)
+			{
+				for (Draw& collected : collectContexts_[worker]->draws)
+				{
+					if (drawCount == draws->size())
+					{
+						draws->emplace_back();
+					}
+					Draw& draw = (*draws)[drawCount];
+					drawCount += 1;
+
+					draw.layout = std::move(collected.layout);
+					draw.indices = std::move(collected.indices);
+					draw.instances = std::move(collected.instances);
+					draw.material = std::move(collected.material);
+					draw.constant = collected.constant;
+				}
+			}
+			return drawCount;
+		}
+
+	private:
+		/*
+		*	Per worker state of the collection.
+		*/
+		struct CollectContext
+		{
+			RenderablePackCollector collector;
+			std::vector<Draw> draws; // only layout, indices, instances, material and constant are set
+		};
+
+		void CollectEntity(std::shared_ptr<Entity> const& entity, f32M44 const& viewProjectionMatrix, f32M44 const& viewMatrix, Frustum const& frustum, f32 pixelScale,
+			ConstantT const& sharedConstant, CollectContext& collectContext)
+		{
+			Renderable* renderable = entity->GetComponent<Renderable>();
+			if (renderable != nullptr && renderable->IsActive())
+			{
+				Transformation* transformation = entity->GetComponent<Transformation>();
+				f32M44 worldMatrix = transformation->GetWorldMatrix();
+				f32M44 worldViewMatrix = worldMatrix * viewMatrix;
+				RotatedBoundingBox box = Transform(renderable->GetBoundingBox(), worldViewMatrix);
+				if (!IntersectRough(box, frustum))
+				{
+					return;
+				}
+				renderable->GetRenderablePackage(collectContext.collector, frustum, worldViewMatrix, pixelScale);
+
+				// packages are cleared right after, their per frame index and instance lists are taken over
+				for (auto& renderablePackage : collectContext.collector.GetAllPackages())
+				{
+					collectContext.draws.emplace_back();
+					Draw& draw = collectContext.draws.back();
+
+					draw.layout = renderablePackage.layout;
+					draw.indices = std::move(renderablePackage.indices);
+					draw.instances = std::move(renderablePackage.instances);
+					draw.material = renderablePackage.material;
+					draw.constant = sharedConstant;
+					draw.constant.material = draw.material.get();
+					draw.constant.modelToClipMatrix = worldMatrix * viewProjectionMatrix;
+					draw.constant.modelToViewMatrix = worldViewMatrix;
+				}
+				collectContext.collector.Clear();
+			}
+		}
+
+	private:
+		std::vector<std::unique_ptr<CollectContext>> collectContexts_; // pool grown to the worker count
+	};
+}
@@ -2,6 +2,14 @@
 #include "ForwardPipeline.hpp"
 #include "Texture2D.hpp"
 #include "Rasterizer.hpp"
+#include "TileBinner.hpp"
+#include "TriangleCuller.hpp"
+#include "DrawCollector.hpp"
+#include "VertexTransform.hpp"
+#include "LightCulling.hpp"
+#include "LightBVH.hpp"
+#include "PointLightTable.hpp"
+#include "LightGrid.hpp"
 #include "Renderable.hpp"
 #include "Shader.hpp"
 #include "Pipeline.hpp"
@@ -29,8 +37,7 @@ namespace X
 			DirectionalLight* directionalLight;
 			f32V3 directionalLightViewDirection;
 			f32V3 directionalLightHalfVector;
-			std::vector<PointLight*> pointLights;
-			std::vector<f32V3> pointLightViewPositions;
+			PointLightTable const* pointLights; // owned by the pipeline
 		};
 
 		struct ConstantPackage
@@ -41,43 +48,26 @@ namespace X
 			SceneConstantPackage const* sceneConstantPackage;
 		};
 
-
-		struct PreZTransformVertexShader
-			: public VertexShader
+		struct ShadingPixelInputPackage
 		{
-			virtual void Execute(void const* attributeInput, void const* constantInput, void* attributeOutput) override
-			{
-				AttributeInputPackage const* input = static_cast<AttributeInputPackage const*>(attributeInput);
-				ConstantPackage const* constant = static_cast<ConstantPackage const*>(constantInput);
-				f32V4* output = static_cast<f32V4*>(attributeOutput);
+			AttributeOutputPackage const& fragment;
+			u32 const* pointLightIndices; // of the light tile or cluster of the fragment, nullptr to be lit by all point lights
+			u32 pointLightCount;
 
-				f32V4 position = Transform(f32V4(input->vertex.position.X(), input->vertex.position.Y(), input->vertex.position.Z(), 1), constant->modelToClipMatrix);
-				*output = position;
+			ShadingPixelInputPackage(AttributeOutputPackage const& fragment, u32 const* pointLightIndices, u32 pointLightCount)
+				: fragment(fragment), pointLightIndices(pointLightIndices), pointLightCount(pointLightCount)
+			{
 			}
 		};
 
-		struct TransformVertexShader
-			: public VertexShader
-		{
-			virtual void Execute(void const* attributeInput, void const* constantInput, void* attributeOutput) override
-			{
-				AttributeInputPackage const* input = static_cast<AttributeInputPackage const*>(attributeInput);
-				ConstantPackage const* constant = static_cast<ConstantPackage const*>(constantInput);
-				AttributeOutputPackage* output = static_cast<AttributeOutputPackage*>(attributeOutput);
 
-				f32V3 positionInView = Transform(input->vertex.position, constant->modelToViewMatrix);
-				f32V4 position = Transform(f32V4(input->vertex.position.X(), input->vertex.position.Y(), input->vertex.position.Z(), 1), constant->modelToClipMatrix);
-				f32V3 normalInView = TransformDirection(input->vertex.normal, constant->modelToViewMatrix);
-				*output = AttributeOutputPackage(Vertex(positionInView, normalInView, input->vertex.textureCoordinate), position);
-			}
-		};
-		
 		struct ShadingPixelShader
 			: public FragmentShader
 		{
 			virtual void Execute(void const* fragmentInput, void const* constantInput, void* fragmentOutput) override
 			{
-				AttributeOutputPackage const* input = static_cast<AttributeOutputPackage const*>(fragmentInput);
+				ShadingPixelInputPackage const* pixelInput = static_cast<ShadingPixelInputPackage const*>(fragmentInput);
+				AttributeOutputPackage const* input = &pixelInput->fragment;
 				ConstantPackage const* constant = static_cast<ConstantPackage const*>(constantInput);
 				f32V3* output = static_cast<f32V3*>(fragmentOutput);
 
@@ -96,15 +86,17 @@ namespace X
 					f32V3 surfaceNormal = Normalize(input->vertex.normal);
 
 					// point lights
-					for (u32 i = 0; i < constant->sceneConstantPackage->pointLights.size(); ++i)
+					u32 const* pointLightIndices = pixelInput->pointLightIndices;
+					PointLightTable const& pointLights = *constant->sceneConstantPackage->pointLights;
+					u32 pointLightCount = pointLightIndices != nullptr ? pixelInput->pointLightCount : pointLights.GetCount();
+					for (u32 k = 0; k < pointLightCount; ++k)
 					{
-						PointLight* light = constant->sceneConstantPackage->pointLights[i];
-						f32V3 const& lightViewPosition = constant->sceneConstantPackage->pointLightViewPositions[i];
-						f32V3 direction = light->GetLightDirection(lightViewPosition, input->vertex.position);
+						u32 i = pointLightIndices != nullptr ? pointLightIndices[k] : k;
+						f32V3 direction = Normalize(pointLights.GetViewPosition(i) - input->vertex.position);
 						f32 dot = Dot(direction, surfaceNormal);
 						if (dot > 0)
 						{
-							f32V3 intensity = light->GetLightIntensity(lightViewPosition, input->vertex.position);
+							f32V3 intensity = pointLights.GetLightIntensity(i, input->vertex.position);
 							if (intensity.LengthSquared() >= 0.0001)
 							{
 								f32V3 half = Normalize(viewDirection + direction);
@@ -144,44 +136,59 @@ namespace X
 	struct ForwardPipeline::Impl
 	{
 		ForwardPipeline& pipeline_;
-		std::shared_ptr<VertexShader> preZVertexShader_;
-		std::shared_ptr<VertexShader> vertexShader_;
 		std::shared_ptr<FragmentShader> fragmentShader_;
 
 		std::unique_ptr<ConcreteTexture2D<f32>> depthBuffer_;
+		std::unique_ptr<HierarchicalZ> hierarchicalZ_;
 		std::unique_ptr<LineRasterizer> lineRasterizer_;
 		std::unique_ptr<FillRasterizer> fillRasterizer_;
-		std::vector<AttributeOutputPackage> attributeBuffer_;
+		std::unique_ptr<TileBinner> binner_;
+		std::unique_ptr<TriangleCuller> culler_;
+
+		ForwardPipeline::LightCullingMode lightCullingMode_;
+		static const u32 LightTileSize = 16;
+		Size<u32, 2> lightTileCount_;
+		std::vector<std::vector<u32>> tileLightIndices_; // point lights of every light tile, storage reused between frames
+		std::unique_ptr<LightBVH> lightBVH_;
+		PointLightTable pointLightTable_; // storage reused between frames
+		std::unique_ptr<LightGrid> lightGrid_;
 
-		RenderablePackCollector collector_;
+		typedef DrawCollector<ConstantPackage>::Draw Draw;
+		std::vector<Draw> draws_; // storage reused between frames
+		u32 drawCount_;
+		VertexStatistics vertexStatistics_; // sum of the draws of the last frame
+		TriangleStatistics triangleStatistics_; // sum of the draws of the last frame
+
+		DrawCollector<ConstantPackage> drawCollector_;
 
 		PerformanceCounter& performanceCounter_;
 		Context& context_;
 
 		Impl(ForwardPipeline& pipeline)
-			: pipeline_(pipeline), performanceCounter_(pipeline.GetRenderer().GetContext().GetPerformanceCounter()), context_(pipeline.GetRenderer().GetContext())
+			: pipeline_(pipeline),
+			lightTileCount_((pipeline.GetBufferSize().X() + LightTileSize - 1) / LightTileSize, (pipeline.GetBufferSize().Y() + LightTileSize - 1) / LightTileSize),
+			performanceCounter_(pipeline.GetRenderer().GetContext().GetPerformanceCounter()), context_(pipeline.GetRenderer().GetContext())
 		{
 			depthBuffer_ = std::make_unique<ConcreteTexture2D<f32>>(pipeline.GetBufferSize());
+			hierarchicalZ_ = std::make_unique<HierarchicalZ>(pipeline.GetBufferSize());
 
 			lineRasterizer_ = std::make_unique<LineRasterizer>();
-			fillRasterizer_ = std::make_unique<FillRasterizer>();
+			fillRasterizer_ = std::make_unique<FillRasterizer>(FillRasterizer::Mode::Hierarchical);
+			fillRasterizer_->SetHierarchicalZ(hierarchicalZ_.get());
+			binner_ = std::make_unique<TileBinner>(pipeline.GetBufferSize());
+			culler_ = std::make_unique<TriangleCuller>(pipeline.GetBufferSize());
+			lightCullingMode_ = ForwardPipeline::LightCullingMode::Clustered;
+			tileLightIndices_.resize(lightTileCount_.X() * lightTileCount_.Y());
+			lightBVH_ = std::make_unique<LightBVH>();
+			lightGrid_ = std::make_unique<LightGrid>(pipeline.GetBufferSize());
+			drawCount_ = 0;
+			vertexStatistics_ = VertexStatistics();
+			triangleStatistics_ = TriangleStatistics();
 
-			preZVertexShader_ = std::make_shared<PreZTransformVertexShader>();
-			vertexShader_ = std::make_shared<TransformVertexShader>();
 			fragmentShader_ = std::make_shared<ShadingPixelShader>();
 
 		}
 
-		struct PreZContinuation
-		{
-			PreZContinuation(Impl& impl, ConstantPackage* constant)
-			{
-			}
-			void operator() (AttributeOutputPackage const& fragmentInput, Point<u32, 2> sceenCoordinate) const
-			{
-			}
-		};
-
 		struct ShadingContinuation
 		{
 			Impl& impl;
@@ -192,114 +199,312 @@ namespace X
 			}
 			void operator() (AttributeOutputPackage const& fragmentInput, Point<u32, 2> sceenCoordinate) const
 			{
+				ShadingPixelInputPackage input = impl.MakeShadingInput(fragmentInput, sceenCoordinate);
 				f32V3 element;
-				(*impl.fragmentShader_)(&fragmentInput, &constant, &element);
+				(*impl.fragmentShader_)(&input, &constant, &element);
 				impl.pipeline_.GetRenderer().GetColorBuffer().SetValue(0, sceenCoordinate, element);
 			}
+			void operator() (FragmentPacket const& packet, u32 activeMask) const
+			{
+				ForEachActiveFragment(packet, activeMask, *this);
+			}
 		};
 
-		template <typename FragmentContinuationT>
-		void RenderMesh(std::shared_ptr<Entity> const& entity, f32M44 const& viewProjectionMatrix, f32M44 const& viewMatrix, Frustum const& frustum, SceneConstantPackage const* sceneConstant)
+		/*
+		*	With the point lights of the light tile or the cluster of the fragment, nullptr if lights are not culled.
+		*/
+		ShadingPixelInputPackage MakeShadingInput(AttributeOutputPackage const& fragment, Point<u32, 2> const& sceenCoordinate) const
 		{
-			Renderable* renderable = entity->GetComponent<Renderable>();
-			if (renderable != nullptr && renderable->IsActive())
+			switch (lightCullingMode_)
 			{
-				Transformation* transformation = entity->GetComponent<Transformation>();
-				f32M44 worldMatrix = transformation->GetWorldMatrix();
-				f32M44 worldViewMatrix = worldMatrix * viewMatrix;
-				RotatedBoundingBox box = Transform(renderable->GetBoundingBox(), worldViewMatrix);
-				if (!IntersectRough(box, frustum))
+			case ForwardPipeline::LightCullingMode::Tiled:
 				{
-					return;
+					std::vector<u32> const& lightIndices = tileLightIndices_[sceenCoordinate.Y() / LightTileSize * lightTileCount_.X() + sceenCoordinate.X() / LightTileSize];
+					return ShadingPixelInputPackage(fragment, lightIndices.data(), u32(lightIndices.size()));
 				}
-				renderable->GetRenderablePackage(collector_, frustum, worldViewMatrix);
-
-				for (auto& renderablePackage : collector_.GetAllPackages())
+			case ForwardPipeline::LightCullingMode::Clustered:
 				{
-					ConstantPackage constant;
-					constant.material = renderablePackage.material.get();
-					constant.modelToClipMatrix = worldMatrix * viewProjectionMatrix;
-					constant.modelToViewMatrix = worldMatrix * viewMatrix;
-					constant.sceneConstantPackage = sceneConstant;
-
-
-					std::vector<u16> const& indices = renderablePackage.layout->GetIndexBuffer()->GetData();
-					assert(indices.size() % 3 == 0);
-					std::vector<Vertex> const& vertices = renderablePackage.layout->GetVertexBuffer()->GetData();
-					if (attributeBuffer_.size() < vertices.size())
-					{
-						attributeBuffer_.resize(vertices.size());
-					}
+					u32 cluster = lightGrid_->GetClusterIndex(sceenCoordinate, fragment.vertex.position.Z());
+					return ShadingPixelInputPackage(fragment, lightGrid_->GetClusterLights(cluster), lightGrid_->GetClusterLightCount(cluster));
+				}
+			default:
+				return ShadingPixelInputPackage(fragment, nullptr, 0);
+			}
+		}
 
-					Material::RasterizeMode mode = renderablePackage.material->GetRasterizeMode();
+		/*
+		*	After the pre-z pass, every light tile keeps the point lights intersecting the frustum of its depth range.
+		*	Line mode draws are not in the pre-z pass, they are only lit by the lights of the depth range of the tile.
+		*/
+		void CullLights(f32M44 const& projectionMatrix)
+		{
+			Size<u32, 2> bufferSize = pipeline_.GetBufferSize();
+			auto cullTile = [&] (u32 tileIndex)
+			{
+				Rectangle<u32> tile(tileIndex % lightTileCount_.X() * LightTileSize, tileIndex / lightTileCount_.X() * LightTileSize, 0, 0);
+				tile.width = std::min(LightTileSize, bufferSize.X() - tile.x);
+				tile.height = std::min(LightTileSize, bufferSize.Y() - tile.y);
 
-					// vertex shading
-					for (u32 i = 0; i < vertices.size(); ++i)
+				f32 minDepth = 1;
+				f32 maxDepth = 0;
+				for (u32 y = tile.y; y < tile.y + tile.height; ++y)
+				{
+					for (u32 x = tile.x; x < tile.x + tile.width; ++x)
 					{
-						(*vertexShader_)(&AttributeInputPackage(vertices[i]), &constant, &attributeBuffer_[i]);
+						f32 depth = depthBuffer_->GetValue(0, Point<u32, 2>(x, y));
+						// 1 is the clear value, nothing drawn there
+						if (depth < 1)
+						{
+							minDepth = std::min(depth, minDepth);
+							maxDepth = std::max(depth, maxDepth);
+						}
 					}
+				}
 
-					FragmentContinuationT continuation(*this, &constant);
-
-					// rasterize
-					switch (mode)
+				std::vector<u32>& lightIndices = tileLightIndices_[tileIndex];
+				lightIndices.clear();
+				if (minDepth <= maxDepth)
+				{
+					TileDepthMask depthMask(DepthToViewZ(projectionMatrix, minDepth), DepthToViewZ(projectionMatrix, maxDepth));
+					for (u32 y = tile.y; y < tile.y + tile.height; ++y)
 					{
-					case Material::RasterizeMode::Line:
-						for (u32 i = 0; i < indices.size(); i += 3)
-						{
-							AttributeOutputPackage& v0 = attributeBuffer_[indices[i + 0]];
-							AttributeOutputPackage& v1 = attributeBuffer_[indices[i + 1]];
-							AttributeOutputPackage& v2 = attributeBuffer_[indices[i + 2]];
-							lineRasterizer_->Rasterize(pipeline_.GetBufferSize(), *depthBuffer_, continuation, Triangle(v0, v1, v2));
-						}
-						break;
-					case Material::RasterizeMode::Fill:
-						performanceCounter_.Begin(PerformanceCounter::Term::ForwardTotalRasterize);
-						if (context_.GetThreadSupport() == 1)
+						for (u32 x = tile.x; x < tile.x + tile.width; ++x)
 						{
-							for (u32 i = 0; i < indices.size(); i += 3)
+							f32 depth = depthBuffer_->GetValue(0, Point<u32, 2>(x, y));
+							if (depth < 1)
 							{
-								AttributeOutputPackage& v0 = attributeBuffer_[indices[i + 0]];
-								AttributeOutputPackage& v1 = attributeBuffer_[indices[i + 1]];
-								AttributeOutputPackage& v2 = attributeBuffer_[indices[i + 2]];
-								Triangle triangle(v0, v1, v2);
-								fillRasterizer_->Rasterize(pipeline_.GetBufferSize(), *depthBuffer_, continuation, Triangle(v0, v1, v2));
+								depthMask.Add(DepthToViewZ(projectionMatrix, depth));
 							}
 						}
-						else
-						{
-							concurrency::parallel_for(0u, indices.size() / 3, [this, &indices, &continuation] (u32 index)
-							{
-								AttributeOutputPackage& v0 = attributeBuffer_[indices[index * 3 + 0]];
-								AttributeOutputPackage& v1 = attributeBuffer_[indices[index * 3 + 1]];
-								AttributeOutputPackage& v2 = attributeBuffer_[indices[index * 3 + 2]];
-								Triangle triangle(v0, v1, v2);
-								fillRasterizer_->Rasterize(pipeline_.GetBufferSize(), *depthBuffer_, continuation, triangle);
-							});
-						}
-						performanceCounter_.End(PerformanceCounter::Term::ForwardTotalRasterize);
-						break;
-					default:
-						assert(false);
-						break;
 					}
+					Frustum frustum = MakeTileFrustum(projectionMatrix, bufferSize, tile, depthMask.minZ, depthMask.maxZ);
+					lightBVH_->Query(frustum, &depthMask, &lightIndices);
+				}
+			};
+
+			u32 tileCount = lightTileCount_.X() * lightTileCount_.Y();
+			if (context_.GetThreadSupport() == 1)
+			{
+				for (u32 i = 0; i < tileCount; ++i)
+				{
+					cullTile(i);
 				}
-				collector_.Clear();
+			}
+			else
+			{
+				concurrency::parallel_for(0u, tileCount, cullTile);
 			}
 		}
 
-		void PreZ(std::shared_ptr<Entity> const& entity, f32M44 const& viewProjectionMatrix, f32M44 const& viewMatrix, Frustum const& frustum, SceneConstantPackage const* sceneConstant)
+		/*
+		*	Position only transform, triangle culling and binning, the visible triangles and the bins are used by both passes.
+		*/
+		void ProcessPreZGeometry(Draw& draw)
 		{
-			RenderMesh<PreZContinuation>(entity, viewProjectionMatrix, viewMatrix, frustum, sceneConstant);
+			IndexData const& indices = draw.GetIndices();
+			assert(indices.GetCount() % 3 == 0);
+			VertexBuffer const& vertices = *draw.layout->GetVertexBuffer();
+			u32 vertexCount = vertices.GetCount();
+			u32 instanceCount = draw.GetInstanceCount();
+			if (draw.positionBuffer.size() < vertexCount * instanceCount)
+			{
+				draw.positionBuffer.resize(vertexCount * instanceCount);
+			}
+
+			for (u32 i = 0; i < instanceCount; ++i)
+			{
+				TransformPositions(vertices, draw.GetModelToClipMatrix(i), draw.positionBuffer.data() + i * vertexCount);
+			}
+
+			if (draw.material->GetRasterizeMode() == Material::RasterizeMode::Fill)
+			{
+				culler_->Cull(draw.positionBuffer, indices, instanceCount, vertexCount, fillRasterizer_->GetGuardBand(), &draw.visible);
+				binner_->Bin(draw.positionBuffer, indices, vertexCount, draw.visible, &draw.bins);
+			}
+			else
+			{
+				draw.visible.statistics = TriangleStatistics();
+			}
 		}
 
-		void Render(std::shared_ptr<Entity> const& entity, f32M44 const& viewProjectionMatrix, f32M44 const& viewMatrix, Frustum const& frustum, SceneConstantPackage const* sceneConstant)
+		void ProcessGeometry(Draw& draw)
 		{
-			RenderMesh<ShadingContinuation>(entity, viewProjectionMatrix, viewMatrix, frustum, sceneConstant);
+			IndexData const& indices = draw.GetIndices();
+			VertexBuffer const& vertices = *draw.layout->GetVertexBuffer();
+			u32 vertexCount = vertices.GetCount();
+			u32 instanceCount = draw.GetInstanceCount();
+			if (draw.attributeBuffer.size() < vertexCount * instanceCount)
+			{
+				draw.attributeBuffer.resize(vertexCount * instanceCount);
+			}
+
+			// vertex shading, instances are always batched
+			if (pipeline_.GetVertexProcessingMode() == Pipeline::VertexProcessingMode::PostTransformCache
+				&& draw.material->GetRasterizeMode() == Material::RasterizeMode::Fill && draw.instances.empty())
+			{
+				// only triangles surviving culling in the pre-z pass are ever read
+				TransformVisibleVertices(vertices, indices, draw.visible.triangles, draw.constant.modelToViewMatrix, draw.constant.modelToClipMatrix,
+					draw.attributeBuffer.data(), &draw.vertexMarks, &draw.vertexStatistics);
+			}
+			else
+			{
+				for (u32 i = 0; i < instanceCount; ++i)
+				{
+					TransformVertices(vertices, draw.GetModelToViewMatrix(i), draw.GetModelToClipMatrix(i), draw.attributeBuffer.data() + i * vertexCount);
+				}
+				draw.vertexStatistics.vertexCount = vertexCount * instanceCount;
+				draw.vertexStatistics.uniqueVertexCount = vertexCount * instanceCount;
+				draw.vertexStatistics.shadedVertexCount = vertexCount * instanceCount;
+			}
 		}
 
+		template <typename FunctionT>
+		void ForEachDraw(FunctionT const& function)
+		{
+			if (context_.GetThreadSupport() == 1)
+			{
+				for (u32 i = 0; i < drawCount_; ++i)
+				{
+					function(draws_[i]);
+				}
+			}
+			else
+			{
+				concurrency::parallel_for(0u, drawCount_, [this, &function] (u32 index)
+				{
+					function(draws_[index]);
+				});
+			}
+		}
 
+		// every tile is owned by one worker, draws in a tile are in submission order
+		template <typename FunctionT>
+		void ForEachTile(FunctionT const& function)
+		{
+			if (context_.GetThreadSupport() == 1)
+			{
+				for (u32 i = 0; i < binner_->GetTileCount(); ++i)
+				{
+					function(i);
+				}
+			}
+			else
+			{
+				concurrency::parallel_for(0u, binner_->GetTileCount(), [&function] (u32 tileIndex)
+				{
+					function(tileIndex);
+				});
+			}
+		}
+
+		void RasterizeTileDepth(u32 tileIndex)
+		{
+			Rectangle<u32> tile = binner_->GetTileRectangle(tileIndex);
+			for (u32 i = 0; i < drawCount_; ++i)
+			{
+				Draw& draw = draws_[i];
+				if (draw.material->GetRasterizeMode() != Material::RasterizeMode::Fill)
+				{
+					continue;
+				}
+				draw.GetIndices().Visit([&] (auto const& indices)
+				{
+					for (u32 k = draw.bins.tileOffsets[tileIndex]; k < draw.bins.tileOffsets[tileIndex + 1]; ++k)
+					{
+						u32 visibleIndex = draw.bins.triangles[k];
+						std::array<u32, 3> corners = draw.GetTriangleVertices(indices, draw.visible.triangles[visibleIndex]);
+						fillRasterizer_->RasterizeDepth(pipeline_.GetBufferSize(), *depthBuffer_,
+							draw.positionBuffer[corners[0]],
+							draw.positionBuffer[corners[1]],
+							draw.positionBuffer[corners[2]], tile, draw.visible.clipping[visibleIndex] != 0);
+					}
+				});
+			}
+		}
+
+		void RasterizeTile(u32 tileIndex)
+		{
+			Rectangle<u32> tile = binner_->GetTileRectangle(tileIndex);
+			for (u32 i = 0; i < drawCount_; ++i)
+			{
+				Draw& draw = draws_[i];
+				if (draw.material->GetRasterizeMode() != Material::RasterizeMode::Fill)
+				{
+					continue;
+				}
+				draw.GetIndices().Visit([&] (auto const& indices)
+				{
+					ShadingContinuation continuation(*this, &draw.constant);
+					for (u32 k = draw.bins.tileOffsets[tileIndex]; k < draw.bins.tileOffsets[tileIndex + 1]; ++k)
+					{
+						u32 visibleIndex = draw.bins.triangles[k];
+						std::array<u32, 3> corners = draw.GetTriangleVertices(indices, draw.visible.triangles[visibleIndex]);
+						AttributeOutputPackage& v0 = draw.attributeBuffer[corners[0]];
+						AttributeOutputPackage& v1 = draw.attributeBuffer[corners[1]];
+						AttributeOutputPackage& v2 = draw.attributeBuffer[corners[2]];
+						fillRasterizer_->RasterizeCulled(pipeline_.GetBufferSize(), *depthBuffer_, continuation, Triangle(v0, v1, v2), tile,
+							draw.visible.clipping[visibleIndex] != 0);
+					}
+				});
+			}
+		}
+
+		/*
+		*	Depth only, positions are transformed and rasterized without any attribute.
+		*/
+		void PreZ()
+		{
+			ForEachDraw([this] (Draw& draw)
+			{
+				ProcessPreZGeometry(draw);
+			});
+			triangleStatistics_ = SumTriangleStatistics(draws_, drawCount_);
+
+			performanceCounter_.Begin(PerformanceCounter::Term::ForwardTotalRasterize);
+			ForEachTile([this] (u32 tileIndex)
+			{
+				RasterizeTileDepth(tileIndex);
+			});
+			performanceCounter_.End(PerformanceCounter::Term::ForwardTotalRasterize);
+		}
+
+		void Render()
+		{
+			ForEachDraw([this] (Draw& draw)
+			{
+				ProcessGeometry(draw);
+			});
+			vertexStatistics_ = SumVertexStatistics(draws_, drawCount_);
 
+			performanceCounter_.Begin(PerformanceCounter::Term::ForwardTotalRasterize);
+			ForEachTile([this] (u32 tileIndex)
+			{
+				RasterizeTile(tileIndex);
+			});
+			performanceCounter_.End(PerformanceCounter::Term::ForwardTotalRasterize);
+
+			// line mode is for debugging, not binned and not in the pre-z pass
+			for (u32 i = 0; i < drawCount_; ++i)
+			{
+				Draw& draw = draws_[i];
+				if (draw.material->GetRasterizeMode() != Material::RasterizeMode::Line)
+				{
+					continue;
+				}
+				draw.GetIndices().Visit([&] (auto const& indices)
+				{
+					ShadingContinuation continuation(*this, &draw.constant);
+					for (u32 k = 0; k < draw.GetTriangleCount(); ++k)
+					{
+						std::array<u32, 3> corners = draw.GetTriangleVertices(indices, k);
+						AttributeOutputPackage& v0 = draw.attributeBuffer[corners[0]];
+						AttributeOutputPackage& v1 = draw.attributeBuffer[corners[1]];
+						AttributeOutputPackage& v2 = draw.attributeBuffer[corners[2]];
+						lineRasterizer_->Rasterize(pipeline_.GetBufferSize(), *depthBuffer_, continuation, Triangle(v0, v1, v2));
+					}
+				});
+			}
+		}
 	};
 
 	ForwardPipeline::ForwardPipeline(Renderer& renderer, Size<u32, 2> const& bufferSize)
@@ -313,6 +518,37 @@ namespace X
 	{
 	}
 
+	void ForwardPipeline::SetLightCullingMode(LightCullingMode mode)
+	{
+		impl_->lightCullingMode_ = mode;
+	}
+
+	ForwardPipeline::LightCullingMode ForwardPipeline::GetLightCullingMode() const
+	{
+		return impl_->lightCullingMode_;
+	}
+
+	RasterizerStatistics ForwardPipeline::GetRasterizerStatistics() const
+	{
+		FillRasterizer::BlockStatistics blockStatistics = impl_->fillRasterizer_->GetBlockStatistics();
+		RasterizerStatistics statistics;
+		statistics.acceptedBlockCount = blockStatistics.accepted;
+		statistics.rejectedBlockCount = blockStatistics.rejected;
+		statistics.splitBlockCount = blockStatistics.split;
+		statistics.occludedBlockCount = blockStatistics.occluded;
+		return statistics;
+	}
+
+	VertexStatistics ForwardPipeline::GetVertexStatistics() const
+	{
+		return impl_->vertexStatistics_;
+	}
+
+	TriangleStatistics ForwardPipeline::GetTriangleStatistics() const
+	{
+		return impl_->triangleStatistics_;
+	}
+
 	void ForwardPipeline::RenderScene(f64 current, f32 delta)
 	{
 		Scene& scene = GetRenderer().GetContext().GetScene();
@@ -324,19 +560,22 @@ namespace X
 		colorBuffer.Clear(0, colorClearValue);
 
 		impl_->depthBuffer_->Clear(0, 1.f);
+		impl_->hierarchicalZ_->Clear(1.f);
+		impl_->fillRasterizer_->ClearBlockStatistics();
 
 		SceneConstantPackage sceneConstant;
 		sceneConstant.ambientLight = nullptr;
 		sceneConstant.directionalLight = nullptr;
 		sceneConstant.directionalLightViewDirection = f32V3(0, 0, 0);
-		sceneConstant.pointLights.clear();
-		sceneConstant.pointLightViewPositions.clear();
+		std::vector<PointLight*> pointLights;
+		std::vector<f32V3> pointLightPositions;
 
 
 		f32M44 viewMatrix = camera->GetComponent<Camera>()->GetViewMatrix();
 		f32M44 projectionMatrix = camera->GetComponent<Camera>()->GetProjectionMatrix();
 		Frustum const& frustum = camera->GetComponent<Camera>()->GetFrustum();
 		f32M44 viewProjectionMatrix = viewMatrix * projectionMatrix;
+		f32 pixelScale = GetPixelScale(projectionMatrix, GetBufferSize());
 
 		for (auto& entity : entities)
 		{
@@ -359,10 +598,8 @@ namespace X
 				}
 				else if (PointLight* pointLight = dynamic_cast<PointLight*>(light))
 				{
-					sceneConstant.pointLights.push_back(pointLight);
-					f32V3 lightPosition = pointLight->GetOwner()->GetComponent<Transformation>()->GetPosition();
-					f32V3 lightViewPosition = Transform(lightPosition, viewMatrix);
-					sceneConstant.pointLightViewPositions.push_back(lightViewPosition);
+					pointLights.push_back(pointLight);
+					pointLightPositions.push_back(pointLight->GetOwner()->GetComponent<Transformation>()->GetPosition());
 				}
 				else
 				{
@@ -370,18 +607,41 @@ namespace X
 				}
 			}
 		}
-		impl_->performanceCounter_.Begin(PerformanceCounter::Term::ForwardPreZPass);
-		concurrency::parallel_for_each(entities.begin(), entities.end(), [this, &viewMatrix, &viewProjectionMatrix, &frustum] (std::shared_ptr<Entity> const& entity)
+		MakePointLightTable(pointLights, pointLightPositions, viewMatrix, &impl_->pointLightTable_);
+		sceneConstant.pointLights = &impl_->pointLightTable_;
+
+		// both culling modes look up lights in the BVH
+		if (impl_->lightCullingMode_ != LightCullingMode::None)
+		{
+			impl_->performanceCounter_.Begin(PerformanceCounter::Term::LightBVHBuild);
+			impl_->lightBVH_->Build(impl_->pointLightTable_.spheres, impl_->context_.GetThreadSupport());
+			impl_->performanceCounter_.End(PerformanceCounter::Term::LightBVHBuild);
+		}
+
+		// clusters do not depend on the depth buffer
+		if (impl_->lightCullingMode_ == LightCullingMode::Clustered)
 		{
-			impl_->PreZ(entity, viewProjectionMatrix, viewMatrix, frustum, nullptr);
-		});
+			impl_->performanceCounter_.Begin(PerformanceCounter::Term::ClusteredLightAssignment);
+			impl_->lightGrid_->Build(projectionMatrix, impl_->pointLightTable_.spheres, *impl_->lightBVH_, impl_->context_.GetThreadSupport());
+			impl_->performanceCounter_.End(PerformanceCounter::Term::ClusteredLightAssignment);
+		}
+
+		impl_->performanceCounter_.Begin(PerformanceCounter::Term::ForwardPreZPass);
+		ConstantPackage sharedConstant = ConstantPackage();
+		sharedConstant.sceneConstantPackage = &sceneConstant;
+		impl_->drawCount_ = impl_->drawCollector_.Collect(entities, viewProjectionMatrix, viewMatrix, frustum, pixelScale, sharedConstant, impl_->context_.GetThreadSupport(), &impl_->draws_);
+		impl_->PreZ();
 		impl_->performanceCounter_.End(PerformanceCounter::Term::ForwardPreZPass);
 
-		impl_->performanceCounter_.Begin(PerformanceCounter::Term::ForwardRenderPass);
-		concurrency::parallel_for_each(entities.begin(), entities.end(), [this, &viewMatrix, &viewProjectionMatrix, &frustum, &sceneConstant] (std::shared_ptr<Entity> const& entity)
+		if (impl_->lightCullingMode_ == LightCullingMode::Tiled)
 		{
-			impl_->Render(entity, viewProjectionMatrix, viewMatrix, frustum, &sceneConstant);
-		});
+			impl_->performanceCounter_.Begin(PerformanceCounter::Term::ForwardLightCulling);
+			impl_->CullLights(projectionMatrix);
+			impl_->performanceCounter_.End(PerformanceCounter::Term::ForwardLightCulling);
+		}
+
+		impl_->performanceCounter_.Begin(PerformanceCounter::Term::ForwardRenderPass);
+		impl_->Render();
 		impl_->performanceCounter_.End(PerformanceCounter::Term::ForwardRenderPass);
 
 	}
@@ -6,12 +6,27 @@ namespace X
 	class ForwardPipeline
 		: public Pipeline
 	{
+	public:
+		enum class LightCullingMode
+		{
+			None, // every fragment is lit by all point lights
+			Tiled, // Forward+, point lights culled per screen tile against the depth range of the pre-z pass
+			Clustered, // point lights assigned to a light grid of screen tiles and depth slices, fragments look up their cluster
+		};
+
 	public:
 		ForwardPipeline(Renderer& renderer, Size<u32, 2> const& bufferSize);
 		virtual ~ForwardPipeline() override;
 
 		virtual void RenderScene(f64 current, f32 delta) override;
 
+		void SetLightCullingMode(LightCullingMode mode);
+		LightCullingMode GetLightCullingMode() const;
+
+		virtual RasterizerStatistics GetRasterizerStatistics() const override;
+		virtual VertexStatistics GetVertexStatistics() const override;
+		virtual TriangleStatistics GetTriangleStatistics() const override;
+
 	private:
 
 		struct Impl;
@@ -1,8 +1,35 @@
 #include "Header.hpp"
 #include "GeometryLayout.hpp"
+#include "MeshSimplifier.hpp"
 
 namespace X
 {
+	void GeometryLayout::BuildLevels(u32 maxLevelCount)
+	{
+		static const u32 MinTriangleCount = 64;
 
+		assert(!vertexBuffer_->IsCompressed());
+		levels_.clear();
+		std::vector<Vertex> const& vertices = vertexBuffer_->GetData();
+		indexBuffer_->GetData().Visit([&] (auto const& indices)
+		{
+			std::decay_t<decltype(indices)> current = indices;
+			f32 error = 0;
+			while (levels_.size() < maxLevelCount && current.size() / 3 >= MinTriangleCount * 2)
+			{
+				f32 levelError = 0;
+				auto simplified = SimplifyMesh(vertices, current, current.size() / 6 * 3, std::numeric_limits<f32>::max(), &levelError);
+				if (simplified.size() > current.size() * 3 / 4)
+				{
+					// stalled, mostly locked vertices left
+					break;
+				}
+				// each level is simplified from the previous one, errors add up
+				error += levelError;
+				Level level = { std::make_shared<GeometryLayout>(vertexBuffer_, std::make_shared<IndexBuffer>(simplified)), error };
+				levels_.push_back(std::move(level));
+				current = std::move(simplified);
+			}
+		});
+	}
 }
-
@@ -1,11 +1,22 @@
 #pragma once
 #include "Common.hpp"
 #include "Buffer.hpp"
+#include "Meshlet.hpp"
 
 namespace X
 {
 	class GeometryLayout
 	{
+	public:
+		/*
+		*	A simplified version drawn in place of the layout when its error is small enough on screen.
+		*/
+		struct Level
+		{
+			std::shared_ptr<GeometryLayout> layout; // shares the vertex buffer
+			f32 error; // largest deviation from the full detail layout, in model space
+		};
+
 	public:
 		GeometryLayout(std::shared_ptr<VertexBuffer> vertexBuffer, std::shared_ptr<IndexBuffer> indexBuffer)
 			: vertexBuffer_(std::move(vertexBuffer)), indexBuffer_(std::move(indexBuffer))
@@ -22,9 +33,42 @@ namespace X
 			return indexBuffer_;
 		}
 
+		/*
+		*	Partition the index buffer into meshlets, must be called again after the buffers change.
+		*	The vertex buffer must not be compressed yet.
+		*/
+		void BuildMeshlets()
+		{
+			assert(!vertexBuffer_->IsCompressed());
+			meshlets_ = X::BuildMeshlets(vertexBuffer_->GetData(), indexBuffer_->GetData());
+		}
+		/*
+		*	Empty if not built.
+		*/
+		std::vector<Meshlet> const& GetMeshlets() const
+		{
+			return meshlets_;
+		}
+
+		/*
+		*	Simplify the index buffer repeatedly to half the triangles, until maxLevelCount levels are built,
+		*	too few triangles are left, or locked seams and borders stop the simplification.
+		*	The vertex buffer must not be compressed yet.
+		*/
+		void BuildLevels(u32 maxLevelCount);
+		/*
+		*	From fine to coarse, the layout itself is not included. Empty if not built.
+		*/
+		std::vector<Level> const& GetLevels() const
+		{
+			return levels_;
+		}
+
 	private:
 		std::shared_ptr<VertexBuffer> vertexBuffer_;
 		std::shared_ptr<IndexBuffer> indexBuffer_;
+		std::vector<Meshlet> meshlets_;
+		std::vector<Level> levels_;
 	};
 }
 
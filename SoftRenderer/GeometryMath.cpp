@@ -14,6 +14,16 @@ namespace X
 		return (distance - effectiveRadius <= 0);
 	}
 
+	bool Intersect(Plane const& plane, BoundingBox const& box)
+	{
+		// the rotated box test with axes along x y z
+		f32V3 const& normal = plane.GetNormal();
+		f32V3 const& halfExtend = box.GetHalfExtend();
+		f32 effectiveRadius = std::abs(normal.X()) * halfExtend.X() + std::abs(normal.Y()) * halfExtend.Y() + std::abs(normal.Z()) * halfExtend.Z();
+		f32 distance = plane.SignedDistance(box.GetPosition());
+		return (distance - effectiveRadius <= 0);
+	}
+
 
 	bool IntersectRough(RotatedBoundingBox const& box, Frustum const& frustum)
 	{
@@ -28,6 +38,19 @@ namespace X
 		return true;
 	}
 
+	bool IntersectRough(BoundingBox const& box, Frustum const& frustum)
+	{
+		std::array<Plane, 6> const& faces = frustum.GetFaces();
+		for (Plane const& p : faces)
+		{
+			if (!Intersect(p, box))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
 	bool IntersectRough(Sphere const& sphere, Frustum const& frustum)
 	{
 		std::array<Plane, 6> const& faces = frustum.GetFaces();
@@ -29,6 +29,17 @@ namespace X
 	{
 		return Intersect(plane, box);
 	}
+	/*
+	*	It always considered as intersected when box is at negative half plane.
+	*/
+	bool Intersect(Plane const& plane, BoundingBox const& box);
+	/*
+	*	It always considered as intersected when box is at negative half plane.
+	*/
+	inline bool Intersect(BoundingBox const& box, Plane const& plane)
+	{
+		return Intersect(plane, box);
+	}
 
 	bool IntersectRough(RotatedBoundingBox const& box, Frustum const& frustum);
 	inline bool IntersectRough(Frustum const& frustum, RotatedBoundingBox const& box)
@@ -36,6 +47,12 @@ namespace X
 		return IntersectRough(box, frustum);
 	}
 
+	bool IntersectRough(BoundingBox const& box, Frustum const& frustum);
+	inline bool IntersectRough(Frustum const& frustum, BoundingBox const& box)
+	{
+		return IntersectRough(box, frustum);
+	}
+
 	bool IntersectRough(Sphere const& sphere, Frustum const& frustum);
 	inline bool IntersectRough(Frustum const& frustum, Sphere const& sphere)
 	{
@@ -0,0 +1,92 @@
+#include "Header.hpp"
+#include "HierarchicalZ.hpp"
+#include "CPUFeature.hpp"
+
+#include <immintrin.h>
+
+namespace X
+{
+	HierarchicalZ::HierarchicalZ(Size<u32, 2> const& resolution)
+		: resolution_(resolution),
+		blockCount_((resolution.X() + BlockSize - 1) / BlockSize, (resolution.Y() + BlockSize - 1) / BlockSize),
+		tileCount_((resolution.X() + TileSize - 1) / TileSize, (resolution.Y() + TileSize - 1) / TileSize)
+	{
+		static_assert(TileSize % BlockSize == 0, "a tile is made of whole blocks.");
+		blockMaxDepths_.resize(blockCount_.X() * blockCount_.Y());
+		tileMaxDepths_.resize(tileCount_.X() * tileCount_.Y());
+	}
+
+	void HierarchicalZ::Clear(f32 depth)
+	{
+		std::fill(blockMaxDepths_.begin(), blockMaxDepths_.end(), depth);
+		std::fill(tileMaxDepths_.begin(), tileMaxDepths_.end(), depth);
+	}
+
+	f32 HierarchicalZ::GetMaxDepth(u32 xMin, u32 yMin, u32 xMax, u32 yMax) const
+	{
+		f32 maxDepth = 0;
+		for (u32 y = yMin / TileSize; y <= yMax / TileSize; ++y)
+		{
+			for (u32 x = xMin / TileSize; x <= xMax / TileSize; ++x)
+			{
+				maxDepth = std::max(maxDepth, tileMaxDepths_[y * tileCount_.X() + x]);
+			}
+		}
+		return maxDepth;
+	}
+
+	void HierarchicalZ::UpdateBlock(u32 blockX, u32 blockY, ConcreteTexture2D<f32>& depthBuffer)
+	{
+		u32 xBegin = blockX * BlockSize;
+		u32 yBegin = blockY * BlockSize;
+		u32 blockSize = BlockSize;
+		u32 width = std::min(blockSize, resolution_.X() - xBegin);
+		u32 height = std::min(blockSize, resolution_.Y() - yBegin);
+		f32 const* depths = depthBuffer.GetValues(0) + yBegin * resolution_.X() + xBegin;
+
+		f32 maxDepth = 0;
+		if (width == 8 && GetCPUFeature().avx2)
+		{
+			__m256 maxVector = _mm256_setzero_ps();
+			for (u32 y = 0; y < height; ++y)
+			{
+				maxVector = _mm256_max_ps(maxVector, _mm256_loadu_ps(depths + y * resolution_.X()));
+			}
+			__m128 max4 = _mm_max_ps(_mm256_castps256_ps128(maxVector), _mm256_extractf128_ps(maxVector, 1));
+			__m128 max2 = _mm_max_ps(max4, _mm_movehl_ps(max4, max4));
+			__m128 max1 = _mm_max_ss(max2, _mm_shuffle_ps(max2, max2, 1));
+			maxDepth = _mm_cvtss_f32(max1);
+		}
+		else
+		{
+			for (u32 y = 0; y < height; ++y)
+			{
+				for (u32 x = 0; x < width; ++x)
+				{
+					maxDepth = std::max(maxDepth, depths[y * resolution_.X() + x]);
+				}
+			}
+		}
+		blockMaxDepths_[blockY * blockCount_.X() + blockX] = maxDepth;
+	}
+
+	void HierarchicalZ::UpdateTiles(u32 blockXMin, u32 blockYMin, u32 blockXMax, u32 blockYMax)
+	{
+		u32 const BlocksPerTile = TileSize / BlockSize;
+		for (u32 tileY = blockYMin / BlocksPerTile; tileY <= blockYMax / BlocksPerTile; ++tileY)
+		{
+			for (u32 tileX = blockXMin / BlocksPerTile; tileX <= blockXMax / BlocksPerTile; ++tileX)
+			{
+				f32 maxDepth = 0;
+				for (u32 y = tileY * BlocksPerTile; y < std::min((tileY + 1) * BlocksPerTile, blockCount_.Y()); ++y)
+				{
+					for (u32 x = tileX * BlocksPerTile; x < std::min((tileX + 1) * BlocksPerTile, blockCount_.X()); ++x)
+					{
+						maxDepth = std::max(maxDepth, blockMaxDepths_[y * blockCount_.X() + x]);
+					}
+				}
+				tileMaxDepths_[tileY * tileCount_.X() + tileX] = maxDepth;
+			}
+		}
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "Common.hpp"
+#include "Texture2D.hpp"
+
+namespace X
+{
+	/*
+	*	Conservative max depth of every BlockSize x BlockSize block and every TileSize x TileSize tile of a depth buffer.
+	*	Depth only decreases under the less equal depth test, so a value not yet updated is still an upper bound.
+	*/
+	class HierarchicalZ
+		: Noncopyable
+	{
+	public:
+		static const u32 BlockSize = 8;
+		static const u32 TileSize = 64;
+
+	public:
+		explicit HierarchicalZ(Size<u32, 2> const& resolution);
+
+		void Clear(f32 depth);
+
+		f32 GetBlockMaxDepth(u32 blockX, u32 blockY) const
+		{
+			return blockMaxDepths_[blockY * blockCount_.X() + blockX];
+		}
+		/*
+		*	Max depth of the tiles overlapping the inclusive pixel range.
+		*/
+		f32 GetMaxDepth(u32 xMin, u32 yMin, u32 xMax, u32 yMax) const;
+
+		/*
+		*	Recalculate the max depth of a block from the depth buffer after it is written.
+		*/
+		void UpdateBlock(u32 blockX, u32 blockY, ConcreteTexture2D<f32>& depthBuffer);
+		/*
+		*	Recalculate the max depth of the tiles overlapping the inclusive block range from their blocks.
+		*/
+		void UpdateTiles(u32 blockXMin, u32 blockYMin, u32 blockXMax, u32 blockYMax);
+
+	private:
+		Size<u32, 2> resolution_;
+		Size<u32, 2> blockCount_;
+		Size<u32, 2> tileCount_;
+		std::vector<f32> blockMaxDepths_;
+		std::vector<f32> tileMaxDepths_;
+	};
+}
@@ -0,0 +1,166 @@
+#include "Header.hpp"
+#include "InstancedMesh.hpp"
+#include "GeometryLayout.hpp"
+#include "CPUFeature.hpp"
+
+#include <immintrin.h>
+
+namespace X
+{
+	namespace
+	{
+		static const u32 BatchSize = 8;
+
+		BoundingBox CalculateLayoutBoundingBox(VertexBuffer const& vertexBuffer)
+		{
+			if (vertexBuffer.IsCompressed())
+			{
+				// every decoded position is inside the quantization range
+				VertexQuantization const& quantization = vertexBuffer.GetQuantization();
+				f32V3 halfExtend = 65535.f * quantization.scale / 2;
+				return BoundingBox(quantization.offset + halfExtend, halfExtend);
+			}
+
+			static const f32 FloatMax = std::numeric_limits<f32>::max();
+			f32V3 min(FloatMax, FloatMax, FloatMax);
+			f32V3 max(-FloatMax, -FloatMax, -FloatMax);
+			for (Vertex const& v : vertexBuffer.GetData())
+			{
+				min = f32V3(std::min(min.X(), v.position.X()), std::min(min.Y(), v.position.Y()), std::min(min.Z(), v.position.Z()));
+				max = f32V3(std::max(max.X(), v.position.X()), std::max(max.Y(), v.position.Y()), std::max(max.Z(), v.position.Z()));
+			}
+			if (vertexBuffer.GetData().empty())
+			{
+				return BoundingBox(f32V3(0, 0, 0), f32V3(0, 0, 0));
+			}
+			f32V3 center = (min + max) / 2;
+			return BoundingBox(center, center - min);
+		}
+
+		// longest axis of the matrix, bounding sphere radii are scaled by it
+		f32 MaxAxisScale(f32M44 const& matrix)
+		{
+			return std::sqrt(std::max(std::max(
+				TransformDirection(f32V3(1, 0, 0), matrix).LengthSquared(),
+				TransformDirection(f32V3(0, 1, 0), matrix).LengthSquared()),
+				TransformDirection(f32V3(0, 0, 1), matrix).LengthSquared()));
+		}
+
+		/*
+		*	Bit i is set if sphere i, transformed by the affine matrix, intersects the frustum.
+		*	The same test as IntersectRough(Sphere, Frustum).
+		*/
+		u32 CullSpheresAVX(f32 const* x, f32 const* y, f32 const* z, f32 const* radius, f32M44 const& matrix, f32 radiusScale, Frustum const& frustum)
+		{
+			__m256 sourceX = _mm256_loadu_ps(x);
+			__m256 sourceY = _mm256_loadu_ps(y);
+			__m256 sourceZ = _mm256_loadu_ps(z);
+			__m256 centerX = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sourceX, _mm256_set1_ps(matrix[0])),
+				_mm256_mul_ps(sourceY, _mm256_set1_ps(matrix[4]))), _mm256_mul_ps(sourceZ, _mm256_set1_ps(matrix[8]))), _mm256_set1_ps(matrix[12]));
+			__m256 centerY = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sourceX, _mm256_set1_ps(matrix[1])),
+				_mm256_mul_ps(sourceY, _mm256_set1_ps(matrix[5]))), _mm256_mul_ps(sourceZ, _mm256_set1_ps(matrix[9]))), _mm256_set1_ps(matrix[13]));
+			__m256 centerZ = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sourceX, _mm256_set1_ps(matrix[2])),
+				_mm256_mul_ps(sourceY, _mm256_set1_ps(matrix[6]))), _mm256_mul_ps(sourceZ, _mm256_set1_ps(matrix[10]))), _mm256_set1_ps(matrix[14]));
+			__m256 scaledRadius = _mm256_mul_ps(_mm256_loadu_ps(radius), _mm256_set1_ps(radiusScale));
+
+			__m256 intersect = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (Plane const& plane : frustum.GetFaces())
+			{
+				f32V3 const& normal = plane.GetNormal();
+				__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(centerX, _mm256_set1_ps(normal.X())),
+					_mm256_mul_ps(centerY, _mm256_set1_ps(normal.Y()))), _mm256_mul_ps(centerZ, _mm256_set1_ps(normal.Z()))), _mm256_set1_ps(plane.GetDistance()));
+				intersect = _mm256_and_ps(intersect, _mm256_cmp_ps(distance, scaledRadius, _CMP_LE_OQ));
+			}
+			return u32(_mm256_movemask_ps(intersect));
+		}
+	}
+
+	InstancedMesh::InstancedMesh(std::shared_ptr<GeometryLayout> layout, std::shared_ptr<Material> material)
+		: layout_(std::move(layout)), material_(std::move(material)),
+		layoutBoundingBox_(CalculateLayoutBoundingBox(*layout_->GetVertexBuffer())), boundingBox_(f32V3(0, 0, 0), f32V3(0, 0, 0))
+	{
+	}
+
+	InstancedMesh::~InstancedMesh()
+	{
+	}
+
+	void InstancedMesh::SetInstances(std::vector<f32M44> matrices)
+	{
+		instances_ = std::move(matrices);
+
+		u32 paddedCount = (u32(instances_.size()) + BatchSize - 1) / BatchSize * BatchSize;
+		sphereX_.assign(paddedCount, 0.f);
+		sphereY_.assign(paddedCount, 0.f);
+		sphereZ_.assign(paddedCount, 0.f);
+		sphereRadius_.assign(paddedCount, 0.f);
+
+		static const f32 FloatMax = std::numeric_limits<f32>::max();
+		f32V3 min(FloatMax, FloatMax, FloatMax);
+		f32V3 max(-FloatMax, -FloatMax, -FloatMax);
+		f32 layoutRadius = layoutBoundingBox_.GetHalfExtend().Length();
+		for (u32 i = 0; i < instances_.size(); ++i)
+		{
+			f32V3 center = Transform(layoutBoundingBox_.GetPosition(), instances_[i]);
+			f32 radius = layoutRadius * MaxAxisScale(instances_[i]);
+			sphereX_[i] = center.X();
+			sphereY_[i] = center.Y();
+			sphereZ_[i] = center.Z();
+			sphereRadius_[i] = radius;
+
+			min = f32V3(std::min(min.X(), center.X() - radius), std::min(min.Y(), center.Y() - radius), std::min(min.Z(), center.Z() - radius));
+			max = f32V3(std::max(max.X(), center.X() + radius), std::max(max.Y(), center.Y() + radius), std::max(max.Z(), center.Z() + radius));
+		}
+
+		if (instances_.empty())
+		{
+			boundingBox_ = BoundingBox(f32V3(0, 0, 0), f32V3(0, 0, 0));
+		}
+		else
+		{
+			f32V3 center = (min + max) / 2;
+			boundingBox_ = BoundingBox(center, center - min);
+		}
+	}
+
+	void InstancedMesh::GetRenderablePackage(RenderablePackCollector& collector, Frustum const& frustum, f32M44 const& worldViewMatrix, f32 pixelScale)
+	{
+		u32 instanceCount = u32(instances_.size());
+		f32 radiusScale = MaxAxisScale(worldViewMatrix);
+
+		std::vector<f32M44> visible;
+		visible.reserve(instanceCount);
+		if (GetCPUFeature().avx)
+		{
+			for (u32 i = 0; i < instanceCount; i += BatchSize)
+			{
+				u32 mask = CullSpheresAVX(&sphereX_[i], &sphereY_[i], &sphereZ_[i], &sphereRadius_[i], worldViewMatrix, radiusScale, frustum);
+				// lanes of the padding are dropped
+				u32 laneCount = std::min(instanceCount - i, BatchSize);
+				for (u32 lane = 0; lane < laneCount; ++lane)
+				{
+					if ((mask & (1u << lane)) != 0)
+					{
+						visible.push_back(instances_[i + lane]);
+					}
+				}
+			}
+		}
+		else
+		{
+			for (u32 i = 0; i < instanceCount; ++i)
+			{
+				Sphere sphereInView(Transform(f32V3(sphereX_[i], sphereY_[i], sphereZ_[i]), worldViewMatrix), sphereRadius_[i] * radiusScale);
+				if (IntersectRough(sphereInView, frustum))
+				{
+					visible.push_back(instances_[i]);
+				}
+			}
+		}
+
+		if (!visible.empty())
+		{
+			collector.AddPackage(RenderablePackage(*this, layout_, material_, std::move(visible)));
+		}
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "Common.hpp"
+#include "Renderable.hpp"
+
+
+namespace X
+{
+	/*
+	*	One layout drawn with many model matrices, the instances not culled go to the pipeline as a single package
+	*	and are transformed, culled and rasterized as one draw.
+	*	Instances are culled by their bounding spheres, 8 at a time with AVX when supported.
+	*/
+	class InstancedMesh
+		: public Renderable
+	{
+	public:
+		InstancedMesh(std::shared_ptr<GeometryLayout> layout, std::shared_ptr<Material> material);
+		virtual ~InstancedMesh() override;
+
+		virtual void GetRenderablePackage(RenderablePackCollector& collector, Frustum const& frustum, f32M44 const& worldViewMatrix, f32 pixelScale) override;
+
+		virtual BoundingBox GetBoundingBox() override
+		{
+			return boundingBox_;
+		}
+
+		/*
+		*	@matrices: model matrix of every instance, relative to the transformation of the owner.
+		*/
+		void SetInstances(std::vector<f32M44> matrices);
+		std::vector<f32M44> const& GetInstances() const
+		{
+			return instances_;
+		}
+
+		std::shared_ptr<GeometryLayout> const& GetGeometryLayout() const
+		{
+			return layout_;
+		}
+		std::shared_ptr<Material> const& GetMaterial() const
+		{
+			return material_;
+		}
+
+	private:
+		std::shared_ptr<GeometryLayout> layout_;
+		std::shared_ptr<Material> material_;
+
+		BoundingBox layoutBoundingBox_; // of the vertices, in model space of an instance
+		BoundingBox boundingBox_; // of all the instances
+
+		std::vector<f32M44> instances_;
+		// bounding spheres of the instances in structure of arrays form, padded to a multiple of 8
+		std::vector<f32> sphereX_;
+		std::vector<f32> sphereY_;
+		std::vector<f32> sphereZ_;
+		std::vector<f32> sphereRadius_;
+	};
+}
@@ -48,8 +48,7 @@ namespace X
 	{
 		f32V3 l = lightPosition - objectPosition;
 		f32 distanceSquared = l.LengthSquared();
-		// see Real Shading in Unreal Engine 4.
-		f32 falloff = Square(Clamp(1 - Square(distanceSquared / Square(radius_)), 0.f, 1.f)) / (distanceSquared * inverseScaleSquare_ + 1);
+		f32 falloff = PointLightFalloff(distanceSquared, radius_, inverseScaleSquare_);
 		assert(0.f <= falloff && falloff <= 1.f);
 		return intensity_ * falloff;
 	}
@@ -50,6 +50,14 @@ namespace X
 		f32V3 intensity_;
 	};
 
+	/*
+	*	Falloff of a point light at the squared distance, see Real Shading in Unreal Engine 4.
+	*/
+	inline f32 PointLightFalloff(f32 distanceSquared, f32 radius, f32 inverseScaleSquare)
+	{
+		return Square(Clamp(1 - Square(distanceSquared / Square(radius)), 0.f, 1.f)) / (distanceSquared * inverseScaleSquare + 1);
+	}
+
 	class PointLight
 		: public Light
 	{
@@ -58,6 +66,13 @@ namespace X
 		virtual ~PointLight() override;
 
 		f32V3 GetLightIntensity(f32V3 const& lightPosition, f32V3 const& objectPosition);
+		/*
+		*	Before the falloff.
+		*/
+		f32V3 GetLightIntensity() const
+		{
+			return intensity_;
+		}
 
 		f32V3 GetLightDirection(f32V3 const& lightPosition, f32V3 const& objectPosition)
 		{
@@ -69,6 +84,10 @@ namespace X
 		{
 			return radius_;
 		}
+		f32 GetInverseScaleSquare() const
+		{
+			return inverseScaleSquare_;
+		}
 
 	private:
 		f32V3 intensity_;
@@ -0,0 +1,178 @@
+#include "Header.hpp"
+#include "LightBVH.hpp"
+
+#include <ppl.h>
+
+namespace X
+{
+	namespace
+	{
+		template <typename FunctionT>
+		void ForEachIndex(u32 count, u32 threadSupport, FunctionT const& function)
+		{
+			if (threadSupport == 1)
+			{
+				for (u32 i = 0; i < count; ++i)
+				{
+					function(i);
+				}
+			}
+			else
+			{
+				concurrency::parallel_for(0u, count, function);
+			}
+		}
+
+		// 10 bits spread to every third bit
+		u32 ExpandBits(u32 value)
+		{
+			value = (value * 0x00010001u) & 0xFF0000FFu;
+			value = (value * 0x00000101u) & 0x0F00F00Fu;
+			value = (value * 0x00000011u) & 0xC30C30C3u;
+			value = (value * 0x00000005u) & 0x49249249u;
+			return value;
+		}
+	}
+
+	LightBVH::LightBVH()
+		: firstLeafNode_(0)
+	{
+		sortedSpheres_.count = 0;
+	}
+
+	LightBVH::~LightBVH()
+	{
+	}
+
+	void LightBVH::Build(PointLightSpheres const& spheres, u32 threadSupport)
+	{
+		u32 count = spheres.count;
+		if (count == 0)
+		{
+			sortedSpheres_.count = 0;
+			nodes_.clear();
+			return;
+		}
+
+		static const f32 FloatMax = std::numeric_limits<f32>::max();
+		f32V3 min(FloatMax, FloatMax, FloatMax);
+		f32V3 max(-FloatMax, -FloatMax, -FloatMax);
+		for (u32 i = 0; i < count; ++i)
+		{
+			min = f32V3(std::min(min.X(), spheres.x[i]), std::min(min.Y(), spheres.y[i]), std::min(min.Z(), spheres.z[i]));
+			max = f32V3(std::max(max.X(), spheres.x[i]), std::max(max.Y(), spheres.y[i]), std::max(max.Z(), spheres.z[i]));
+		}
+		f32V3 extend = max - min;
+		f32V3 scale = f32V3(1023 / std::max(extend.X(), 1e-6f), 1023 / std::max(extend.Y(), 1e-6f), 1023 / std::max(extend.Z(), 1e-6f));
+
+		keys_.resize(count);
+		ForEachIndex(count, threadSupport, [&] (u32 i)
+		{
+			u32 x = std::min(u32((spheres.x[i] - min.X()) * scale.X()), 1023u);
+			u32 y = std::min(u32((spheres.y[i] - min.Y()) * scale.Y()), 1023u);
+			u32 z = std::min(u32((spheres.z[i] - min.Z()) * scale.Z()), 1023u);
+			u32 code = (ExpandBits(x) << 2) | (ExpandBits(y) << 1) | ExpandBits(z);
+			keys_[i] = (u64(code) << 32) | i;
+		});
+		if (threadSupport == 1)
+		{
+			std::sort(keys_.begin(), keys_.end());
+		}
+		else
+		{
+			concurrency::parallel_sort(keys_.begin(), keys_.end());
+		}
+
+		// padded with empty spheres, dropped by CullSphereBatch
+		u32 leafCount = (count + LeafSize - 1) / LeafSize;
+		sortedSpheres_.count = count;
+		sortedSpheres_.x.assign(leafCount * LeafSize, 0.f);
+		sortedSpheres_.y.assign(leafCount * LeafSize, 0.f);
+		sortedSpheres_.z.assign(leafCount * LeafSize, 0.f);
+		sortedSpheres_.radius.assign(leafCount * LeafSize, 0.f);
+		sortedIndices_.resize(count);
+		ForEachIndex(count, threadSupport, [&] (u32 i)
+		{
+			u32 light = u32(keys_[i]);
+			sortedIndices_[i] = light;
+			sortedSpheres_.x[i] = spheres.x[light];
+			sortedSpheres_.y[i] = spheres.y[light];
+			sortedSpheres_.z[i] = spheres.z[light];
+			sortedSpheres_.radius[i] = spheres.radius[light];
+		});
+
+		u32 paddedLeafCount = 1;
+		while (paddedLeafCount < leafCount)
+		{
+			paddedLeafCount *= 2;
+		}
+		firstLeafNode_ = paddedLeafCount - 1;
+		Node emptyNode = { f32V3(FloatMax, FloatMax, FloatMax), f32V3(-FloatMax, -FloatMax, -FloatMax) };
+		nodes_.assign(firstLeafNode_ + paddedLeafCount, emptyNode);
+
+		ForEachIndex(leafCount, threadSupport, [&] (u32 leaf)
+		{
+			Node& node = nodes_[firstLeafNode_ + leaf];
+			for (u32 i = leaf * LeafSize; i < std::min((leaf + 1) * LeafSize, count); ++i)
+			{
+				f32 radius = sortedSpheres_.radius[i];
+				node.min = f32V3(std::min(node.min.X(), sortedSpheres_.x[i] - radius), std::min(node.min.Y(), sortedSpheres_.y[i] - radius), std::min(node.min.Z(), sortedSpheres_.z[i] - radius));
+				node.max = f32V3(std::max(node.max.X(), sortedSpheres_.x[i] + radius), std::max(node.max.Y(), sortedSpheres_.y[i] + radius), std::max(node.max.Z(), sortedSpheres_.z[i] + radius));
+			}
+		});
+		// fewer inner nodes than leaves, each one a union of two boxes, cheap enough serially
+		for (u32 n = firstLeafNode_; n-- > 0;)
+		{
+			Node const& left = nodes_[2 * n + 1];
+			Node const& right = nodes_[2 * n + 2];
+			nodes_[n].min = f32V3(std::min(left.min.X(), right.min.X()), std::min(left.min.Y(), right.min.Y()), std::min(left.min.Z(), right.min.Z()));
+			nodes_[n].max = f32V3(std::max(left.max.X(), right.max.X()), std::max(left.max.Y(), right.max.Y()), std::max(left.max.Z(), right.max.Z()));
+		}
+	}
+
+	void LightBVH::Query(Frustum const& frustum, TileDepthMask const* depthMask, std::vector<u32>* lightIndices) const
+	{
+		lightIndices->clear();
+		if (nodes_.empty())
+		{
+			return;
+		}
+
+		// depth first, a path is at most 32 nodes long
+		std::array<u32, 64> stack;
+		u32 stackSize = 0;
+		stack[stackSize++] = 0;
+		while (stackSize > 0)
+		{
+			u32 n = stack[--stackSize];
+			Node const& node = nodes_[n];
+			if (node.min.X() > node.max.X() || !IntersectRough(BoundingBox((node.min + node.max) / 2, (node.max - node.min) / 2), frustum))
+			{
+				continue;
+			}
+			if (n < firstLeafNode_)
+			{
+				stack[stackSize++] = 2 * n + 2;
+				stack[stackSize++] = 2 * n + 1;
+				continue;
+			}
+
+			u32 first = (n - firstLeafNode_) * LeafSize;
+			u32 mask = CullSphereBatch(frustum, sortedSpheres_, first);
+			for (u32 lane = 0; lane < LeafSize; ++lane)
+			{
+				if ((mask & (1u << lane)) == 0)
+				{
+					continue;
+				}
+				u32 i = first + lane;
+				f32 z = sortedSpheres_.z[i];
+				f32 radius = sortedSpheres_.radius[i];
+				if (depthMask == nullptr || (depthMask->GetBits(z - radius, z + radius) & depthMask->occupancy) != 0)
+				{
+					lightIndices->push_back(sortedIndices_[i]);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "Common.hpp"
+#include "LightCulling.hpp"
+
+namespace X
+{
+	/*
+	*	Linear bounding volume hierarchy of point light spheres, rebuilt every frame from the view space spheres.
+	*	Lights are sorted by the Morton codes of their centers and grouped 8 to a leaf in that order,
+	*	the tree above the leaves is a complete binary tree in heap layout, see 'Fast BVH Construction on GPUs' by Lauterbach et al.
+	*/
+	class LightBVH
+		: Noncopyable
+	{
+	public:
+		static const u32 LeafSize = 8; // one sphere batch of CullSphereBatch
+
+	public:
+		LightBVH();
+		~LightBVH();
+
+		/*
+		*	@threadSupport: 1 to build serially.
+		*/
+		void Build(PointLightSpheres const& spheres, u32 threadSupport);
+
+		/*
+		*	Lights whose spheres intersect the frustum, in the order of the leaves.
+		*	@depthMask: if not nullptr, lights not touching an occupied slice of it are dropped.
+		*	@lightIndices: indices into the spheres of the build, cleared first, storage reused.
+		*/
+		void Query(Frustum const& frustum, TileDepthMask const* depthMask, std::vector<u32>* lightIndices) const;
+
+	private:
+		/*
+		*	Bounds of the spheres below, empty if min is greater than max.
+		*/
+		struct Node
+		{
+			f32V3 min;
+			f32V3 max;
+		};
+
+		std::vector<u64> keys_; // Morton code in the high half, light index in the low half
+		PointLightSpheres sortedSpheres_; // in Morton order
+		std::vector<u32> sortedIndices_; // light of every sorted sphere
+		std::vector<Node> nodes_; // children of node n are 2n + 1 and 2n + 2
+		u32 firstLeafNode_;
+	};
+}
@@ -0,0 +1,86 @@
+#include "Header.hpp"
+#include "LightCulling.hpp"
+#include "CPUFeature.hpp"
+
+#include <immintrin.h>
+
+namespace X
+{
+	namespace
+	{
+		static const u32 BatchSize = 8;
+
+		/*
+		*	Bit i is set if sphere i intersects the frustum, the same test as IntersectRough(Sphere, Frustum).
+		*/
+		u32 CullSpheresAVX(f32 const* x, f32 const* y, f32 const* z, f32 const* radius, Frustum const& frustum)
+		{
+			__m256 centerX = _mm256_loadu_ps(x);
+			__m256 centerY = _mm256_loadu_ps(y);
+			__m256 centerZ = _mm256_loadu_ps(z);
+			__m256 sphereRadius = _mm256_loadu_ps(radius);
+
+			__m256 intersect = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (Plane const& plane : frustum.GetFaces())
+			{
+				f32V3 const& normal = plane.GetNormal();
+				__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(centerX, _mm256_set1_ps(normal.X())),
+					_mm256_mul_ps(centerY, _mm256_set1_ps(normal.Y()))), _mm256_mul_ps(centerZ, _mm256_set1_ps(normal.Z()))), _mm256_set1_ps(plane.GetDistance()));
+				intersect = _mm256_and_ps(intersect, _mm256_cmp_ps(distance, sphereRadius, _CMP_LE_OQ));
+			}
+			return u32(_mm256_movemask_ps(intersect));
+		}
+	}
+
+	Frustum MakeTileFrustum(f32M44 const& projectionMatrix, Size<u32, 2> const& bufferSize, Rectangle<u32> const& tile, f32 minZ, f32 maxZ)
+	{
+		// for details, see 'Deferred Rendering for Current and Future Rendering Pipelines' by Intel.
+		// scale and bias map the tile to [-1, 1] of its own projection
+		f32V2 tileScale = f32V2(f32(bufferSize.X()) / tile.width, f32(bufferSize.Y()) / tile.height);
+		f32V2 tileBias = tileScale - f32V2(2.f * tile.x / tile.width, 2.f * tile.y / tile.height) - f32V2(1, 1);
+		// NOTE: below are used by Intel but it's not the most tight frustum
+		//f32V2 tileScale = f32V2(f32(size.groupCount.X()), f32(size.groupCount.Y())) / 2;
+		//f32V2 tileBias = tileScale - f32V2(f32(groupIndex.X()), f32(groupIndex.Y()));
+
+		// projection matrix
+		// relevant matrix columns for this tile frusta
+		f32V3 c1 = f32V3(projectionMatrix(0, 0) * tileScale.X(), 0.0f, tileBias.X());
+		f32V3 c2 = f32V3(0.0f, projectionMatrix(1, 1) * tileScale.Y(), tileBias.Y());
+		f32V3 c4 = f32V3(0.0f, 0.0f, 1.0f);
+
+		// derive frustum planes
+		std::array<Plane, 6> frustumPlanes;
+		// right/left/bottom/top
+		frustumPlanes[0] = Plane(-Normalize(c4 - c1), 0);
+		frustumPlanes[1] = Plane(-Normalize(c4 + c1), 0);
+		frustumPlanes[2] = Plane(-Normalize(c4 - c2), 0);
+		frustumPlanes[3] = Plane(-Normalize(c4 + c2), 0);
+		// near/far
+		frustumPlanes[4] = Plane(f32V3(0.0f, 0.0f, -1.0f), minZ);
+		frustumPlanes[5] = Plane(f32V3(0.0f, 0.0f, 1.0f), -maxZ);
+
+		return Frustum(frustumPlanes);
+	}
+
+	u32 CullSphereBatch(Frustum const& frustum, PointLightSpheres const& spheres, u32 first)
+	{
+		u32 mask = 0;
+		if (GetCPUFeature().avx)
+		{
+			mask = CullSpheresAVX(&spheres.x[first], &spheres.y[first], &spheres.z[first], &spheres.radius[first], frustum);
+		}
+		else
+		{
+			for (u32 lane = 0; lane < BatchSize; ++lane)
+			{
+				u32 i = first + lane;
+				if (IntersectRough(frustum, Sphere(f32V3(spheres.x[i], spheres.y[i], spheres.z[i]), spheres.radius[i])))
+				{
+					mask |= 1u << lane;
+				}
+			}
+		}
+		// lanes of the padding are dropped
+		return mask & ((1u << std::min(spheres.count - first, BatchSize)) - 1);
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "Common.hpp"
+#include "Light.hpp"
+
+namespace X
+{
+	/*
+	*	View space frustum through the pixels of a screen tile, bounded by view space depths minZ and maxZ.
+	*/
+	Frustum MakeTileFrustum(f32M44 const& projectionMatrix, Size<u32, 2> const& bufferSize, Rectangle<u32> const& tile, f32 minZ, f32 maxZ);
+
+	/*
+	*	View space depth of a depth buffer value. The projection maps z to m[10] + m[14] / z in [0, 1],
+	*	the rasterizer stores that as 0.5 * z + 0.5, so depth is in [0.5, 1].
+	*/
+	inline f32 DepthToViewZ(f32M44 const& projectionMatrix, f32 depth)
+	{
+		return projectionMatrix[14] / (2 * depth - 1 - projectionMatrix[10]);
+	}
+
+	/*
+	*	View space bounding spheres of point lights in structure of arrays form, padded to a multiple of 8 with empty spheres.
+	*/
+	struct PointLightSpheres
+	{
+		std::vector<f32> x;
+		std::vector<f32> y;
+		std::vector<f32> z;
+		std::vector<f32> radius;
+		u32 count;
+	};
+
+	/*
+	*	Depth range of a tile split into 32 slices, bit n of occupancy is set if a pixel of the tile is in slice n.
+	*	Lights in the gaps between the surfaces of a tile touch no set bit, see '2.5D Culling for Forward+' by Harada.
+	*/
+	struct TileDepthMask
+	{
+		f32 minZ;
+		f32 maxZ;
+		f32 sliceScale;
+		u32 occupancy;
+
+		TileDepthMask(f32 minZ, f32 maxZ)
+			: minZ(minZ), maxZ(maxZ), sliceScale(maxZ > minZ ? 32 / (maxZ - minZ) : 0), occupancy(0)
+		{
+		}
+
+		void Add(f32 z)
+		{
+			occupancy |= GetBits(z, z);
+		}
+
+		/*
+		*	Slices overlapped by the depth range, clamped to the range of the tile.
+		*/
+		u32 GetBits(f32 nearZ, f32 farZ) const
+		{
+			u32 first = u32(Clamp((nearZ - minZ) * sliceScale, 0.f, 31.f));
+			u32 last = u32(Clamp((farZ - minZ) * sliceScale, 0.f, 31.f));
+			return (0xFFFFFFFFu >> (31 - last)) & (0xFFFFFFFFu << first);
+		}
+	};
+
+	/*
+	*	Bit i is set if sphere first + i intersects the frustum, for the 8 spheres from first.
+	*	Tested with AVX when supported, lanes of the padding are never set.
+	*/
+	u32 CullSphereBatch(Frustum const& frustum, PointLightSpheres const& spheres, u32 first);
+}
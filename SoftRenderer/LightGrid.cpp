@@ -0,0 +1,122 @@
+#include "Header.hpp"
+#include "LightGrid.hpp"
+
+#include <ppl.h>
+
+namespace X
+{
+	LightGrid::LightGrid(Size<u32, 2> const& bufferSize)
+		: bufferSize_(bufferSize),
+		tileCount_((bufferSize.X() + TileSize - 1) / TileSize, (bufferSize.Y() + TileSize - 1) / TileSize),
+		near_(0), far_(0), sliceScale_(0), sliceBias_(0)
+	{
+		clusterLights_.resize(GetClusterCount());
+		tileRowLights_.resize(tileCount_.Y());
+		lightOffsets_.assign(GetClusterCount() + 1, 0);
+	}
+
+	LightGrid::~LightGrid()
+	{
+	}
+
+	u32 LightGrid::GetSlice(f32 viewZ) const
+	{
+		f32 slice = std::log(Clamp(viewZ, near_, far_)) * sliceScale_ + sliceBias_;
+		return std::min(u32(std::max(slice, 0.f)), SliceCount - 1);
+	}
+
+	u32 LightGrid::GetClusterIndex(Point<u32, 2> const& pixel, f32 viewZ) const
+	{
+		return ((pixel.Y() / TileSize) * tileCount_.X() + pixel.X() / TileSize) * SliceCount + GetSlice(viewZ);
+	}
+
+	void LightGrid::Build(f32M44 const& projectionMatrix, PointLightSpheres const& spheres, LightBVH const& lightBVH, u32 threadSupport)
+	{
+		// depth = m[10] + m[14] / z of the projection, 0 at near and 1 at far
+		near_ = -projectionMatrix[14] / projectionMatrix[10];
+		far_ = projectionMatrix[14] / (1 - projectionMatrix[10]);
+		sliceScale_ = SliceCount / std::log(far_ / near_);
+		sliceBias_ = -std::log(near_) * sliceScale_;
+
+		tileFrustums_.clear();
+		for (u32 y = 0; y < tileCount_.Y(); ++y)
+		{
+			for (u32 x = 0; x < tileCount_.X(); ++x)
+			{
+				Rectangle<u32> tile(x * TileSize, y * TileSize, 0, 0);
+				tile.width = std::min(TileSize, bufferSize_.X() - tile.x);
+				tile.height = std::min(TileSize, bufferSize_.Y() - tile.y);
+				tileFrustums_.push_back(MakeTileFrustum(projectionMatrix, bufferSize_, tile, near_, far_));
+			}
+		}
+
+		// every tile row is owned by one worker, so are its clusters
+		auto assign = [&] (u32 tileY)
+		{
+			AssignTileRow(tileY, spheres, lightBVH);
+		};
+		if (threadSupport == 1)
+		{
+			for (u32 y = 0; y < tileCount_.Y(); ++y)
+			{
+				assign(y);
+			}
+		}
+		else
+		{
+			concurrency::parallel_for(0u, tileCount_.Y(), assign);
+		}
+
+		u32 clusterCount = GetClusterCount();
+		for (u32 i = 0; i < clusterCount; ++i)
+		{
+			lightOffsets_[i + 1] = lightOffsets_[i] + u32(clusterLights_[i].size());
+		}
+		lightIndices_.resize(lightOffsets_[clusterCount]);
+
+		auto gather = [this] (u32 tileY)
+		{
+			u32 rowClusterCount = tileCount_.X() * SliceCount;
+			for (u32 i = tileY * rowClusterCount; i < (tileY + 1) * rowClusterCount; ++i)
+			{
+				std::copy(clusterLights_[i].begin(), clusterLights_[i].end(), lightIndices_.begin() + lightOffsets_[i]);
+			}
+		};
+		if (threadSupport == 1)
+		{
+			for (u32 y = 0; y < tileCount_.Y(); ++y)
+			{
+				gather(y);
+			}
+		}
+		else
+		{
+			concurrency::parallel_for(0u, tileCount_.Y(), gather);
+		}
+	}
+
+	void LightGrid::AssignTileRow(u32 tileY, PointLightSpheres const& spheres, LightBVH const& lightBVH)
+	{
+		std::vector<u32>& tileLights = tileRowLights_[tileY];
+		for (u32 tileX = 0; tileX < tileCount_.X(); ++tileX)
+		{
+			u32 tileIndex = tileY * tileCount_.X() + tileX;
+			for (u32 slice = 0; slice < SliceCount; ++slice)
+			{
+				clusterLights_[tileIndex * SliceCount + slice].clear();
+			}
+
+			lightBVH.Query(tileFrustums_[tileIndex], nullptr, &tileLights);
+			for (u32 i : tileLights)
+			{
+				// the frustum is bounded by near and far, so is the depth range of the sphere
+				u32 firstSlice = GetSlice(spheres.z[i] - spheres.radius[i]);
+				u32 lastSlice = GetSlice(spheres.z[i] + spheres.radius[i]);
+				for (u32 slice = firstSlice; slice <= lastSlice; ++slice)
+				{
+					clusterLights_[tileIndex * SliceCount + slice].push_back(i);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "Common.hpp"
+#include "LightBVH.hpp"
+
+namespace X
+{
+	/*
+	*	Clusters of the view frustum, screen tiles times depth slices spaced exponentially between the near and the far plane.
+	*	Point lights are assigned to the clusters once per frame, the lights of all clusters are kept in one flat index list.
+	*/
+	class LightGrid
+		: Noncopyable
+	{
+	public:
+		static const u32 TileSize = 32;
+		static const u32 SliceCount = 24;
+
+	public:
+		LightGrid(Size<u32, 2> const& bufferSize);
+		~LightGrid();
+
+		/*
+		*	Every tile queries the light BVH with its frustum, a light found goes to the slices of its depth range.
+		*	@projectionMatrix: perspective projection of the frame, near and far are taken from it.
+		*	@lightBVH: built from spheres.
+		*	@threadSupport: 1 to build serially.
+		*/
+		void Build(f32M44 const& projectionMatrix, PointLightSpheres const& spheres, LightBVH const& lightBVH, u32 threadSupport);
+
+		/*
+		*	@viewZ: view space depth of the point, clamped to the near and far plane.
+		*/
+		u32 GetClusterIndex(Point<u32, 2> const& pixel, f32 viewZ) const;
+
+		/*
+		*	Indices of the point lights of a cluster, in the order of the light BVH.
+		*/
+		u32 const* GetClusterLights(u32 clusterIndex) const
+		{
+			return lightIndices_.data() + lightOffsets_[clusterIndex];
+		}
+		u32 GetClusterLightCount(u32 clusterIndex) const
+		{
+			return lightOffsets_[clusterIndex + 1] - lightOffsets_[clusterIndex];
+		}
+
+		u32 GetClusterCount() const
+		{
+			return tileCount_.X() * tileCount_.Y() * SliceCount;
+		}
+
+	private:
+		u32 GetSlice(f32 viewZ) const;
+
+		void AssignTileRow(u32 tileY, PointLightSpheres const& spheres, LightBVH const& lightBVH);
+
+	private:
+		Size<u32, 2> bufferSize_;
+		Size<u32, 2> tileCount_;
+		f32 near_;
+		f32 far_;
+		// slice = log(z) * sliceScale_ + sliceBias_
+		f32 sliceScale_;
+		f32 sliceBias_;
+
+		std::vector<Frustum> tileFrustums_; // between near and far, row after row
+		std::vector<std::vector<u32>> tileRowLights_; // lights found for a tile, one per tile row
+		std::vector<std::vector<u32>> clusterLights_; // filled per tile row, storage reused between frames
+		std::vector<u32> lightOffsets_; // cluster n takes lightIndices_[lightOffsets_[n], lightOffsets_[n + 1])
+		std::vector<u32> lightIndices_;
+	};
+}
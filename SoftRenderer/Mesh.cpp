@@ -5,7 +5,7 @@
 namespace X
 {
 	Mesh::Mesh()
-		: boundingBox_(f32V3(0, 0, 0), f32V3(0, 0, 0))
+		: boundingBox_(f32V3(0, 0, 0), f32V3(0, 0, 0)), meshletCulling_(true), levelOfDetail_(true), screenErrorThreshold_(1), screenSizeThreshold_(1)
 	{
 	}
 
@@ -20,15 +20,15 @@ namespace X
 		return *subMeshes_.back();
 	}
 
-	void Mesh::GetRenderablePackage(RenderablePackCollector& collector, Frustum const& frustum, f32M44 const& worldViewMatrix)
+	void Mesh::GetRenderablePackage(RenderablePackCollector& collector, Frustum const& frustum, f32M44 const& worldViewMatrix, f32 pixelScale)
 	{
-
+		f32V3 eye = Transform(f32V3(0, 0, 0), worldViewMatrix.Inverse());
 		for (auto& subMesh : subMeshes_)
 		{
 			RotatedBoundingBox boxInView = Transform(subMesh->GetBoundingBox(), worldViewMatrix);
 			if (IntersectRough(boxInView, frustum))
 			{
-				subMesh->GetRenderablePackage(collector);
+				subMesh->GetRenderablePackage(collector, frustum, worldViewMatrix, eye, pixelScale);
 			}
 		}
 	}
@@ -50,6 +50,13 @@ namespace X
 				min = f32V3(std::min(min.X(), v.position.X()), std::min(min.Y(), v.position.Y()), std::min(min.Z(), v.position.Z()));
 				max = f32V3(std::max(max.X(), v.position.X()), std::max(max.Y(), v.position.Y()), std::max(max.Z(), v.position.Z()));
 			}
+			if (vertexBuffer->IsCompressed())
+			{
+				// every decoded position is inside the quantization range
+				VertexQuantization const& quantization = vertexBuffer->GetQuantization();
+				min = quantization.offset;
+				max = quantization.offset + 65535.f * quantization.scale;
+			}
 			f32V3 center = (min + max) / 2;
 			f32V3 halfExtend = center - min;
 			subMesh->SetBoundingBox(BoundingBox(center, halfExtend));
@@ -63,15 +70,92 @@ namespace X
 		SetBoundingBox(BoundingBox(meshCenter, meshHalfExtend));
 	}
 
+	void Mesh::CompressVertices()
+	{
+		for (auto& subMesh : subMeshes_)
+		{
+			std::shared_ptr<VertexBuffer> const& vertexBuffer = subMesh->GetGeometryLayout()->GetVertexBuffer();
+			// layouts may be shared between sub meshes
+			if (!vertexBuffer->IsCompressed())
+			{
+				vertexBuffer->Compress(subMesh->GetBoundingBox());
+			}
+		}
+	}
+
 
 	Mesh::SubMesh::SubMesh(Mesh& mesh, std::shared_ptr<GeometryLayout> layout, std::shared_ptr<Material> material)
 		: mesh_(mesh), layout_(std::move(layout)), material_(std::move(material)), boundingBox_(f32V3(0, 0, 0), f32V3(0, 0, 0))
 	{
 	}
 
-	void Mesh::SubMesh::GetRenderablePackage(RenderablePackCollector& collector)
+	void Mesh::SubMesh::GetRenderablePackage(RenderablePackCollector& collector, Frustum const& frustum, f32M44 const& worldViewMatrix, f32V3 const& eye, f32 pixelScale)
 	{
-		collector.AddPackage(RenderablePackage(mesh_, layout_, material_));
+		// bounding sphere radius is scaled by the longest axis
+		f32 scale = std::sqrt(std::max(std::max(
+			TransformDirection(f32V3(1, 0, 0), worldViewMatrix).LengthSquared(),
+			TransformDirection(f32V3(0, 1, 0), worldViewMatrix).LengthSquared()),
+			TransformDirection(f32V3(0, 0, 1), worldViewMatrix).LengthSquared()));
+
+		std::shared_ptr<GeometryLayout> layout = layout_;
+		if (mesh_.GetLevelOfDetail())
+		{
+			f32V3 center = Transform(boundingBox_.GetPosition(), worldViewMatrix);
+			f32 radius = boundingBox_.GetHalfExtend().Length() * scale;
+			f32 distance = center.Length() - radius;
+			if (distance > 0)
+			{
+				// screen size of a length at the nearest point of the bounding sphere
+				f32 pixelsPerLength = pixelScale / distance;
+				if (radius * 2 * pixelsPerLength < mesh_.GetScreenSizeThreshold())
+				{
+					return;
+				}
+				for (GeometryLayout::Level const& level : layout_->GetLevels())
+				{
+					if (level.error * scale * pixelsPerLength > mesh_.GetScreenErrorThreshold())
+					{
+						break;
+					}
+					layout = level.layout;
+				}
+			}
+		}
+
+		std::vector<Meshlet> const& meshlets = layout->GetMeshlets();
+		if (!mesh_.GetMeshletCulling() || meshlets.empty())
+		{
+			collector.AddPackage(RenderablePackage(mesh_, layout, material_));
+			return;
+		}
+
+		layout->GetIndexBuffer()->GetData().Visit([&] (auto const& allIndices)
+		{
+			// the same width as the index buffer
+			std::decay_t<decltype(allIndices)> indices;
+			for (Meshlet const& meshlet : meshlets)
+			{
+				if (meshlet.IsBackFacing(eye))
+				{
+					continue;
+				}
+				Sphere sphereInView(Transform(meshlet.center, worldViewMatrix), meshlet.radius * scale);
+				if (!IntersectRough(sphereInView, frustum))
+				{
+					continue;
+				}
+				indices.insert(indices.end(), allIndices.begin() + meshlet.indexOffset, allIndices.begin() + meshlet.indexOffset + meshlet.indexCount);
+			}
+			if (indices.size() == allIndices.size())
+			{
+				// nothing culled, no need to copy
+				collector.AddPackage(RenderablePackage(mesh_, layout, material_));
+			}
+			else if (!indices.empty())
+			{
+				collector.AddPackage(RenderablePackage(mesh_, layout, material_, std::move(indices)));
+			}
+		});
 	}
 
 }
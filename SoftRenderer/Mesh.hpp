@@ -16,7 +16,12 @@ namespace X
 		public:
 			SubMesh(Mesh& mesh, std::shared_ptr<GeometryLayout> layout, std::shared_ptr<Material> material);
 
-			void GetRenderablePackage(RenderablePackCollector& collector);
+			/*
+			*	The coarsest level of the layout within the screen error threshold of the mesh is drawn, nothing if the sub mesh is too small.
+			*	Meshlets of the drawn layout, if built, outside the frustum or back facing are culled.
+			*	@eye: in model space.
+			*/
+			void GetRenderablePackage(RenderablePackCollector& collector, Frustum const& frustum, f32M44 const& worldViewMatrix, f32V3 const& eye, f32 pixelScale);
 
 			std::shared_ptr<GeometryLayout> const& GetGeometryLayout() const
 			{
@@ -51,7 +56,7 @@ namespace X
 
 		SubMesh& CreateSubMesh(std::shared_ptr<GeometryLayout> layout, std::shared_ptr<Material> material);
 
-		virtual void GetRenderablePackage(RenderablePackCollector& collector, Frustum const& frustum, f32M44 const& worldViewMatrix) override;
+		virtual void GetRenderablePackage(RenderablePackCollector& collector, Frustum const& frustum, f32M44 const& worldViewMatrix, f32 pixelScale) override;
 
 		u32 GetSubMeshCount() const
 		{
@@ -74,10 +79,65 @@ namespace X
 		}
 
 		void CalculateBoundingBox();
+		/*
+		*	Compress the vertex buffers of the sub meshes to CompactVertex, quantized inside their bounding boxes.
+		*	Call after CalculateBoundingBox and after meshlets are built.
+		*/
+		void CompressVertices();
+
+		/*
+		*	Cull meshlets of the sub meshes whose layout has them built, on by default.
+		*/
+		void SetMeshletCulling(bool enable)
+		{
+			meshletCulling_ = enable;
+		}
+		bool GetMeshletCulling() const
+		{
+			return meshletCulling_;
+		}
+
+		/*
+		*	Select levels of the layouts, if built, by their error projected on screen, and skip tiny sub meshes. On by default.
+		*/
+		void SetLevelOfDetail(bool enable)
+		{
+			levelOfDetail_ = enable;
+		}
+		bool GetLevelOfDetail() const
+		{
+			return levelOfDetail_;
+		}
+		/*
+		*	Largest error of a level on screen in pixels, 1 by default.
+		*/
+		void SetScreenErrorThreshold(f32 pixels)
+		{
+			screenErrorThreshold_ = pixels;
+		}
+		f32 GetScreenErrorThreshold() const
+		{
+			return screenErrorThreshold_;
+		}
+		/*
+		*	Sub meshes whose bounding sphere is smaller on screen in pixels are skipped, 1 by default.
+		*/
+		void SetScreenSizeThreshold(f32 pixels)
+		{
+			screenSizeThreshold_ = pixels;
+		}
+		f32 GetScreenSizeThreshold() const
+		{
+			return screenSizeThreshold_;
+		}
 
 	private:
 		std::vector<std::unique_ptr<SubMesh>> subMeshes_;
 		BoundingBox boundingBox_;
+		bool meshletCulling_;
+		bool levelOfDetail_;
+		f32 screenErrorThreshold_;
+		f32 screenSizeThreshold_;
 	};
 }
 
@@ -0,0 +1,332 @@
+#include "Header.hpp"
+#include "MeshOptimizer.hpp"
+#include "VertexTransform.hpp"
+
+namespace X
+{
+	namespace
+	{
+		static const u32 NoVertex = ~0u;
+
+		/*
+		*	Tipsify, Sander et al. 2007. Fans around a vertex, the next one is the oldest adjacent vertex
+		*	still in the cache after emitting all its remaining triangles, otherwise a recent one with triangles left.
+		*	@return: triangle order.
+		*/
+		template <typename IndexT>
+		std::vector<u32> Tipsify(std::vector<IndexT> const& indices, u32 vertexCount, u32 cacheSize)
+		{
+			u32 triangleCount = indices.size() / 3;
+
+			// triangles of vertex v are adjacency[offsets[v], offsets[v + 1])
+			std::vector<u32> offsets(vertexCount + 1, 0);
+			for (IndexT index : indices)
+			{
+				offsets[index + 1] += 1;
+			}
+			for (u32 i = 0; i < vertexCount; ++i)
+			{
+				offsets[i + 1] += offsets[i];
+			}
+			std::vector<u32> adjacency(indices.size());
+			std::vector<u32> cursors(offsets.begin(), offsets.end() - 1);
+			for (u32 i = 0; i < indices.size(); ++i)
+			{
+				adjacency[cursors[indices[i]]++] = i / 3;
+			}
+
+			std::vector<u32> liveCounts(vertexCount); // triangles not emitted yet
+			for (u32 i = 0; i < vertexCount; ++i)
+			{
+				liveCounts[i] = offsets[i + 1] - offsets[i];
+			}
+			// a vertex is in the cache if time - cacheTimes[v] <= cacheSize
+			std::vector<u32> cacheTimes(vertexCount, 0);
+			u32 time = cacheSize + 1;
+			std::vector<u8> emitted(triangleCount, 0);
+			std::vector<u32> deadEnds; // recently referenced vertices
+			u32 inputCursor = 0;
+			std::vector<u32> candidates;
+
+			auto skipDeadEnd = [&] ()
+			{
+				while (!deadEnds.empty())
+				{
+					u32 vertex = deadEnds.back();
+					deadEnds.pop_back();
+					if (liveCounts[vertex] > 0)
+					{
+						return vertex;
+					}
+				}
+				for (; inputCursor < vertexCount; ++inputCursor)
+				{
+					if (liveCounts[inputCursor] > 0)
+					{
+						return inputCursor;
+					}
+				}
+				return NoVertex;
+			};
+
+			std::vector<u32> order;
+			order.reserve(triangleCount);
+			u32 fanning = skipDeadEnd();
+			while (fanning != NoVertex)
+			{
+				candidates.clear();
+				for (u32 i = offsets[fanning]; i < offsets[fanning + 1]; ++i)
+				{
+					u32 triangle = adjacency[i];
+					if (emitted[triangle] != 0)
+					{
+						continue;
+					}
+					emitted[triangle] = 1;
+					order.push_back(triangle);
+					for (u32 j = 0; j < 3; ++j)
+					{
+						u32 vertex = indices[triangle * 3 + j];
+						deadEnds.push_back(vertex);
+						candidates.push_back(vertex);
+						liveCounts[vertex] -= 1;
+						if (time - cacheTimes[vertex] > cacheSize)
+						{
+							cacheTimes[vertex] = time;
+							time += 1;
+						}
+					}
+				}
+
+				u32 next = NoVertex;
+				u32 nextPriority = 0;
+				for (u32 vertex : candidates)
+				{
+					if (liveCounts[vertex] == 0)
+					{
+						continue;
+					}
+					u32 priority = 0;
+					if (time - cacheTimes[vertex] + 2 * liveCounts[vertex] <= cacheSize)
+					{
+						priority = time - cacheTimes[vertex];
+					}
+					if (next == NoVertex || priority > nextPriority)
+					{
+						next = vertex;
+						nextPriority = priority;
+					}
+				}
+				fanning = next != NoVertex ? next : skipDeadEnd();
+			}
+			return order;
+		}
+
+		/*
+		*	Cache misses of triangles [begin, end) of the index buffer, starting with an empty cache.
+		*/
+		template <typename IndexT>
+		u32 CountMisses(std::vector<IndexT> const& indices, u32 begin, u32 end)
+		{
+			PostTransformCache cache;
+			u32 misses = 0;
+			for (u32 i = begin * 3; i < end * 3; ++i)
+			{
+				misses += cache.Fetch(indices[i]) ? 0 : 1;
+			}
+			return misses;
+		}
+
+		/*
+		*	Hard boundaries where all vertices of a triangle miss the cache, then soft ones inside
+		*	where the ACMR of the cluster so far is low enough. The cache is flushed at every boundary.
+		*	@return: first triangle of each cluster, in order.
+		*/
+		template <typename IndexT>
+		std::vector<u32> SplitClusters(std::vector<IndexT> const& indices, f32 threshold)
+		{
+			u32 triangleCount = indices.size() / 3;
+			if (triangleCount == 0)
+			{
+				return std::vector<u32>();
+			}
+			// the first triangle always starts a cluster, even with fewer than 3 misses when degenerate
+			std::vector<u32> hardBoundaries;
+			hardBoundaries.push_back(0);
+			PostTransformCache cache;
+			for (u32 i = 0; i < triangleCount; ++i)
+			{
+				u32 misses = 0;
+				for (u32 j = 0; j < 3; ++j)
+				{
+					misses += cache.Fetch(indices[i * 3 + j]) ? 0 : 1;
+				}
+				if (i != 0 && misses == 3)
+				{
+					hardBoundaries.push_back(i);
+				}
+			}
+			hardBoundaries.push_back(triangleCount);
+
+			std::vector<u32> clusters;
+			for (u32 k = 0; k + 1 < hardBoundaries.size(); ++k)
+			{
+				u32 begin = hardBoundaries[k];
+				u32 end = hardBoundaries[k + 1];
+				f32 maxMissRatio = threshold * CountMisses(indices, begin, end) / (end - begin);
+
+				u32 clusterBegin = begin;
+				clusters.push_back(clusterBegin);
+				PostTransformCache clusterCache;
+				u32 clusterMisses = 0;
+				for (u32 i = begin; i < end; ++i)
+				{
+					for (u32 j = 0; j < 3; ++j)
+					{
+						clusterMisses += clusterCache.Fetch(indices[i * 3 + j]) ? 0 : 1;
+					}
+					if (i + 1 < end && clusterMisses <= maxMissRatio * (i + 1 - clusterBegin))
+					{
+						clusterBegin = i + 1;
+						clusters.push_back(clusterBegin);
+						clusterCache = PostTransformCache();
+						clusterMisses = 0;
+					}
+				}
+			}
+			return clusters;
+		}
+
+		/*
+		*	Clusters on the outside of the mesh facing away from its center are drawn first, a view independent
+		*	approximation of front to back order (Sander et al. 2007).
+		*/
+		template <typename IndexT>
+		std::vector<IndexT> SortClusters(std::vector<Vertex> const& vertices, std::vector<IndexT> const& indices, std::vector<u32> const& clusters)
+		{
+			u32 triangleCount = indices.size() / 3;
+			u32 clusterCount = clusters.size();
+			// area weighted centroid and normal, front faces have the geometric normal towards the eye
+			std::vector<f32V3> centroids(clusterCount, f32V3(0, 0, 0));
+			std::vector<f32V3> normals(clusterCount, f32V3(0, 0, 0));
+			std::vector<f32> areas(clusterCount, 0.f);
+			f32V3 meshCentroid(0, 0, 0);
+			f32 meshArea = 0;
+			for (u32 k = 0; k < clusterCount; ++k)
+			{
+				u32 end = k + 1 < clusterCount ? clusters[k + 1] : triangleCount;
+				for (u32 i = clusters[k]; i < end; ++i)
+				{
+					f32V3 const& p0 = vertices[indices[i * 3 + 0]].position;
+					f32V3 const& p1 = vertices[indices[i * 3 + 1]].position;
+					f32V3 const& p2 = vertices[indices[i * 3 + 2]].position;
+					f32V3 normal = Cross(p1 - p0, p2 - p0);
+					f32 area = normal.Length();
+					centroids[k] = centroids[k] + (p0 + p1 + p2) * (area / 3);
+					normals[k] = normals[k] + normal;
+					areas[k] += area;
+				}
+				meshCentroid = meshCentroid + centroids[k];
+				meshArea += areas[k];
+				centroids[k] = areas[k] > 0 ? centroids[k] / areas[k] : centroids[k];
+			}
+			meshCentroid = meshArea > 0 ? meshCentroid / meshArea : meshCentroid;
+
+			std::vector<f32> keys(clusterCount, 0.f);
+			for (u32 k = 0; k < clusterCount; ++k)
+			{
+				if (normals[k].LengthSquared() > 0)
+				{
+					keys[k] = Dot(centroids[k] - meshCentroid, Normalize(normals[k]));
+				}
+			}
+			std::vector<u32> order(clusterCount);
+			for (u32 k = 0; k < clusterCount; ++k)
+			{
+				order[k] = k;
+			}
+			std::stable_sort(order.begin(), order.end(), [&keys] (u32 left, u32 right)
+			{
+				return keys[left] > keys[right];
+			});
+
+			std::vector<IndexT> sorted;
+			sorted.reserve(indices.size());
+			for (u32 k : order)
+			{
+				u32 end = k + 1 < clusterCount ? clusters[k + 1] : triangleCount;
+				sorted.insert(sorted.end(), indices.begin() + clusters[k] * 3, indices.begin() + end * 3);
+			}
+			return sorted;
+		}
+
+		template <typename IndexT>
+		void DoOptimizeMesh(std::vector<Vertex>* vertices, std::vector<IndexT>* indices, f32 overdrawThreshold)
+		{
+			assert(indices->size() % 3 == 0);
+			if (indices->empty())
+			{
+				return;
+			}
+
+			// triangles for the post-transform cache
+			std::vector<u32> triangleOrder = Tipsify(*indices, vertices->size(), PostTransformCache::Size);
+			std::vector<IndexT> reordered;
+			reordered.reserve(indices->size());
+			for (u32 triangle : triangleOrder)
+			{
+				reordered.insert(reordered.end(), indices->begin() + triangle * 3, indices->begin() + triangle * 3 + 3);
+			}
+
+			// clusters for overdraw
+			reordered = SortClusters(*vertices, reordered, SplitClusters(reordered, overdrawThreshold));
+
+			// vertices in order of first use, unreferenced ones last
+			std::vector<u32> remap(vertices->size(), NoVertex);
+			u32 vertexCount = 0;
+			for (IndexT& index : reordered)
+			{
+				if (remap[index] == NoVertex)
+				{
+					remap[index] = vertexCount++;
+				}
+				index = static_cast<IndexT>(remap[index]);
+			}
+			for (u32& newIndex : remap)
+			{
+				if (newIndex == NoVertex)
+				{
+					newIndex = vertexCount++;
+				}
+			}
+			std::vector<Vertex> reorderedVertices(vertices->size(), (*vertices)[0]);
+			for (u32 i = 0; i < vertices->size(); ++i)
+			{
+				reorderedVertices[remap[i]] = (*vertices)[i];
+			}
+
+			*vertices = std::move(reorderedVertices);
+			*indices = std::move(reordered);
+		}
+	}
+
+	u64 CountShadedVertices(std::vector<u16> const& indices)
+	{
+		return CountMisses(indices, 0, indices.size() / 3);
+	}
+
+	u64 CountShadedVertices(std::vector<u32> const& indices)
+	{
+		return CountMisses(indices, 0, indices.size() / 3);
+	}
+
+	void OptimizeMesh(std::vector<Vertex>* vertices, std::vector<u16>* indices, f32 overdrawThreshold)
+	{
+		DoOptimizeMesh(vertices, indices, overdrawThreshold);
+	}
+
+	void OptimizeMesh(std::vector<Vertex>* vertices, std::vector<u32>* indices, f32 overdrawThreshold)
+	{
+		DoOptimizeMesh(vertices, indices, overdrawThreshold);
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "Common.hpp"
+#include "Primitive.hpp"
+
+namespace X
+{
+	/*
+	*	Vertex shader invocations of drawing the triangle list through the post-transform cache of the pipelines.
+	*	Divided by the triangle count it is the average cache miss ratio (ACMR), 0.5 at best for a regular grid and 3 with no reuse.
+	*/
+	u64 CountShadedVertices(std::vector<u16> const& indices);
+	u64 CountShadedVertices(std::vector<u32> const& indices);
+
+	/*
+	*	Reorder triangles for the post-transform cache (Tipsify), then clusters of them so triangles likely in front
+	*	from any view come first, then vertices by first use for fetch locality.
+	*	The triangles and their winding are kept, only the order of the index and vertex buffers changes.
+	*	@overdrawThreshold: a cluster is split where its ACMR stays below this times the ACMR of the unsplit cluster,
+	*		larger gives smaller clusters and a better overdraw order for more cache misses.
+	*/
+	void OptimizeMesh(std::vector<Vertex>* vertices, std::vector<u16>* indices, f32 overdrawThreshold = 1.05f);
+	void OptimizeMesh(std::vector<Vertex>* vertices, std::vector<u32>* indices, f32 overdrawThreshold = 1.05f);
+}
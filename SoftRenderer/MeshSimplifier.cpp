@@ -0,0 +1,373 @@
+#include "Header.hpp"
+#include "MeshSimplifier.hpp"
+
+namespace X
+{
+	namespace
+	{
+		/*
+		*	Sum of squared distances to planes, weighted by triangle area.
+		*	Symmetric 3x3 part a, linear part b, constant c.
+		*/
+		struct Quadric
+		{
+			f64 a00, a01, a02, a11, a12, a22;
+			f64 b0, b1, b2;
+			f64 c;
+			f64 weight;
+
+			Quadric()
+				: a00(0), a01(0), a02(0), a11(0), a12(0), a22(0), b0(0), b1(0), b2(0), c(0), weight(0)
+			{
+			}
+
+			/*
+			*	Plane of dot(normal, p) + d = 0, normal is normalized.
+			*/
+			void AddPlane(f32V3 const& normal, f32 d, f32 planeWeight)
+			{
+				f64 x = normal.X();
+				f64 y = normal.Y();
+				f64 z = normal.Z();
+				f64 w = planeWeight;
+				a00 += w * x * x;
+				a01 += w * x * y;
+				a02 += w * x * z;
+				a11 += w * y * y;
+				a12 += w * y * z;
+				a22 += w * z * z;
+				b0 += w * x * d;
+				b1 += w * y * d;
+				b2 += w * z * d;
+				c += w * d * d;
+				weight += w;
+			}
+
+			Quadric& operator +=(Quadric const& right)
+			{
+				a00 += right.a00;
+				a01 += right.a01;
+				a02 += right.a02;
+				a11 += right.a11;
+				a12 += right.a12;
+				a22 += right.a22;
+				b0 += right.b0;
+				b1 += right.b1;
+				b2 += right.b2;
+				c += right.c;
+				weight += right.weight;
+				return *this;
+			}
+
+			/*
+			*	@return: weighted mean of the squared distances.
+			*/
+			f64 Evaluate(f32V3 const& p) const
+			{
+				f64 x = p.X();
+				f64 y = p.Y();
+				f64 z = p.Z();
+				f64 sum = a00 * x * x + a11 * y * y + a22 * z * z + 2 * (a01 * x * y + a02 * x * z + a12 * y * z)
+					+ 2 * (b0 * x + b1 * y + b2 * z) + c;
+				return weight > 0 ? std::max(sum, 0.0) / weight : 0;
+			}
+		};
+
+		/*
+		*	Half edge collapse, from moves onto to.
+		*/
+		struct Collapse
+		{
+			u32 from;
+			u32 to;
+			f64 cost;
+		};
+
+		/*
+		*	Vertices sharing their position with another vertex (attribute seams),
+		*	or on an edge not shared by exactly 2 triangles (open borders, non-manifold edges).
+		*/
+		template <typename IndexT>
+		std::vector<u8> FindLockedVertices(std::vector<Vertex> const& vertices, std::vector<IndexT> const& indices)
+		{
+			u32 vertexCount = vertices.size();
+			auto less = [&vertices] (u32 left, u32 right)
+			{
+				f32V3 const& l = vertices[left].position;
+				f32V3 const& r = vertices[right].position;
+				if (l.X() != r.X())
+				{
+					return l.X() < r.X();
+				}
+				if (l.Y() != r.Y())
+				{
+					return l.Y() < r.Y();
+				}
+				return l.Z() < r.Z();
+			};
+			std::vector<u32> order(vertexCount);
+			for (u32 i = 0; i < vertexCount; ++i)
+			{
+				order[i] = i;
+			}
+			std::sort(order.begin(), order.end(), less);
+
+			// vertices at the same position share the position id of the first of them
+			std::vector<u32> positionIDs(vertexCount);
+			std::vector<u8> lockedPositions(vertexCount, 0);
+			for (u32 begin = 0, end = 0; begin < vertexCount; begin = end)
+			{
+				end = begin + 1;
+				while (end < vertexCount && !less(order[begin], order[end]))
+				{
+					end += 1;
+				}
+				for (u32 i = begin; i < end; ++i)
+				{
+					positionIDs[order[i]] = order[begin];
+				}
+				lockedPositions[order[begin]] = end - begin > 1 ? 1 : 0;
+			}
+
+			std::vector<u64> edges;
+			edges.reserve(indices.size());
+			for (u32 i = 0; i < indices.size(); i += 3)
+			{
+				for (u32 j = 0; j < 3; ++j)
+				{
+					u32 a = positionIDs[indices[i + j]];
+					u32 b = positionIDs[indices[i + (j + 1) % 3]];
+					if (a != b)
+					{
+						edges.push_back(u64(std::min(a, b)) << 32 | std::max(a, b));
+					}
+				}
+			}
+			std::sort(edges.begin(), edges.end());
+			for (u32 begin = 0, end = 0; begin < edges.size(); begin = end)
+			{
+				end = begin + 1;
+				while (end < edges.size() && edges[end] == edges[begin])
+				{
+					end += 1;
+				}
+				if (end - begin != 2)
+				{
+					lockedPositions[u32(edges[begin] >> 32)] = 1;
+					lockedPositions[u32(edges[begin] & 0xffffffff)] = 1;
+				}
+			}
+
+			std::vector<u8> locked(vertexCount);
+			for (u32 i = 0; i < vertexCount; ++i)
+			{
+				locked[i] = lockedPositions[positionIDs[i]];
+			}
+			return locked;
+		}
+
+		template <typename IndexT>
+		std::vector<Quadric> ComputeQuadrics(std::vector<Vertex> const& vertices, std::vector<IndexT> const& indices)
+		{
+			std::vector<Quadric> quadrics(vertices.size());
+			for (u32 i = 0; i < indices.size(); i += 3)
+			{
+				f32V3 const& p0 = vertices[indices[i + 0]].position;
+				f32V3 const& p1 = vertices[indices[i + 1]].position;
+				f32V3 const& p2 = vertices[indices[i + 2]].position;
+				f32V3 normal = Cross(p1 - p0, p2 - p0);
+				f32 length = normal.Length();
+				if (length == 0)
+				{
+					continue;
+				}
+				normal = normal / length;
+				f32 d = -Dot(normal, p0);
+				for (u32 j = 0; j < 3; ++j)
+				{
+					quadrics[indices[i + j]].AddPlane(normal, d, length / 2);
+				}
+			}
+			return quadrics;
+		}
+
+		f64 CollapseCost(std::vector<Vertex> const& vertices, std::vector<Quadric> const& quadrics, u32 from, u32 to)
+		{
+			Quadric quadric = quadrics[from];
+			quadric += quadrics[to];
+			return quadric.Evaluate(vertices[to].position);
+		}
+
+		/*
+		*	@return: true if a triangle around from, not on the edge, turns over or degenerates by the collapse.
+		*/
+		bool Flips(std::vector<Vertex> const& vertices, std::vector<u32> const& indices, std::vector<u32> const& offsets, std::vector<u32> const& adjacency,
+			u32 from, u32 to)
+		{
+			for (u32 k = offsets[from]; k < offsets[from + 1]; ++k)
+			{
+				u32 t = adjacency[k] * 3;
+				if (indices[t + 0] == to || indices[t + 1] == to || indices[t + 2] == to)
+				{
+					continue;
+				}
+				std::array<f32V3, 3> before;
+				std::array<f32V3, 3> after;
+				for (u32 j = 0; j < 3; ++j)
+				{
+					before[j] = vertices[indices[t + j]].position;
+					after[j] = indices[t + j] == from ? vertices[to].position : before[j];
+				}
+				f32V3 normalBefore = Cross(before[1] - before[0], before[2] - before[0]);
+				f32V3 normalAfter = Cross(after[1] - after[0], after[2] - after[0]);
+				if (Dot(normalBefore, normalAfter) <= 0)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		/*
+		*	Passes over all edges cheapest first, a vertex takes part in one collapse per pass,
+		*	and the neighbors of a moved vertex wait for the next pass, so the flip test sees current positions.
+		*/
+		template <typename IndexT>
+		std::vector<IndexT> DoSimplifyMesh(std::vector<Vertex> const& vertices, std::vector<IndexT> const& input, u32 targetIndexCount, f32 maxError, f32* error)
+		{
+			assert(input.size() % 3 == 0);
+			u32 vertexCount = vertices.size();
+			std::vector<u32> indices(input.begin(), input.end());
+			std::vector<u8> locked = FindLockedVertices(vertices, input);
+			std::vector<Quadric> quadrics = ComputeQuadrics(vertices, input);
+			f64 maxCost = f64(maxError) * maxError;
+			f64 largestCost = 0;
+
+			std::vector<u32> offsets(vertexCount + 1);
+			std::vector<u32> cursors(vertexCount);
+			std::vector<u32> adjacency;
+			std::vector<Collapse> collapses;
+			std::vector<u8> touched(vertexCount);
+			std::vector<u32> remap(vertexCount);
+			while (indices.size() > targetIndexCount)
+			{
+				// triangles of vertex v are adjacency[offsets[v], offsets[v + 1])
+				std::fill(offsets.begin(), offsets.end(), 0);
+				for (u32 index : indices)
+				{
+					offsets[index + 1] += 1;
+				}
+				for (u32 i = 0; i < vertexCount; ++i)
+				{
+					offsets[i + 1] += offsets[i];
+				}
+				std::copy(offsets.begin(), offsets.end() - 1, cursors.begin());
+				adjacency.resize(indices.size());
+				for (u32 i = 0; i < indices.size(); ++i)
+				{
+					adjacency[cursors[indices[i]]++] = i / 3;
+				}
+
+				// the cheaper direction of every edge
+				collapses.clear();
+				for (u32 i = 0; i < indices.size(); i += 3)
+				{
+					for (u32 j = 0; j < 3; ++j)
+					{
+						u32 a = indices[i + j];
+						u32 b = indices[i + (j + 1) % 3];
+						if (a == b || (locked[a] != 0 && locked[b] != 0))
+						{
+							continue;
+						}
+						f64 costAB = locked[a] == 0 ? CollapseCost(vertices, quadrics, a, b) : std::numeric_limits<f64>::max();
+						f64 costBA = locked[b] == 0 ? CollapseCost(vertices, quadrics, b, a) : std::numeric_limits<f64>::max();
+						Collapse collapse = costAB <= costBA ? Collapse{ a, b, costAB } : Collapse{ b, a, costBA };
+						collapses.push_back(collapse);
+					}
+				}
+				std::sort(collapses.begin(), collapses.end(), [] (Collapse const& left, Collapse const& right)
+				{
+					return left.cost < right.cost;
+				});
+
+				std::fill(touched.begin(), touched.end(), 0);
+				for (u32 i = 0; i < vertexCount; ++i)
+				{
+					remap[i] = i;
+				}
+				u32 triangleCount = indices.size() / 3;
+				bool collapsed = false;
+				for (Collapse const& collapse : collapses)
+				{
+					if (collapse.cost > maxCost || triangleCount * 3 <= targetIndexCount)
+					{
+						break;
+					}
+					if (touched[collapse.from] != 0 || touched[collapse.to] != 0
+						|| Flips(vertices, indices, offsets, adjacency, collapse.from, collapse.to))
+					{
+						continue;
+					}
+					for (u32 k = offsets[collapse.from]; k < offsets[collapse.from + 1]; ++k)
+					{
+						u32 t = adjacency[k] * 3;
+						if (indices[t + 0] == collapse.to || indices[t + 1] == collapse.to || indices[t + 2] == collapse.to)
+						{
+							// triangles of the edge degenerate
+							triangleCount -= 1;
+						}
+						touched[indices[t + 0]] = 1;
+						touched[indices[t + 1]] = 1;
+						touched[indices[t + 2]] = 1;
+					}
+					remap[collapse.from] = collapse.to;
+					quadrics[collapse.to] += quadrics[collapse.from];
+					largestCost = std::max(largestCost, collapse.cost);
+					collapsed = true;
+				}
+				if (!collapsed)
+				{
+					break;
+				}
+
+				u32 count = 0;
+				for (u32 i = 0; i < indices.size(); i += 3)
+				{
+					u32 a = remap[indices[i + 0]];
+					u32 b = remap[indices[i + 1]];
+					u32 c = remap[indices[i + 2]];
+					if (a != b && b != c && c != a)
+					{
+						indices[count + 0] = a;
+						indices[count + 1] = b;
+						indices[count + 2] = c;
+						count += 3;
+					}
+				}
+				indices.resize(count);
+			}
+
+			if (error != nullptr)
+			{
+				*error = f32(std::sqrt(largestCost));
+			}
+			std::vector<IndexT> result(indices.size());
+			for (u32 i = 0; i < indices.size(); ++i)
+			{
+				result[i] = static_cast<IndexT>(indices[i]);
+			}
+			return result;
+		}
+	}
+
+	std::vector<u16> SimplifyMesh(std::vector<Vertex> const& vertices, std::vector<u16> const& indices, u32 targetIndexCount, f32 maxError, f32* error)
+	{
+		return DoSimplifyMesh(vertices, indices, targetIndexCount, maxError, error);
+	}
+
+	std::vector<u32> SimplifyMesh(std::vector<Vertex> const& vertices, std::vector<u32> const& indices, u32 targetIndexCount, f32 maxError, f32* error)
+	{
+		return DoSimplifyMesh(vertices, indices, targetIndexCount, maxError, error);
+	}
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "Common.hpp"
+#include "Primitive.hpp"
+
+namespace X
+{
+	/*
+	*	Edge collapse with quadric error metrics (Garland and Heckbert 1997). A vertex moves onto the other end of the edge,
+	*	so the result indexes the same vertex buffer and only the index buffer changes.
+	*	Vertices on open borders and on attribute seams (another vertex at the same position) never move.
+	*	@targetIndexCount: collapsing stops at or below it, earlier if no collapse is left within maxError.
+	*	@maxError: largest deviation allowed, in units of the positions.
+	*	@error: if not nullptr, receives the largest deviation of a collapse done.
+	*	@return: the simplified triangle list, in the order of the input triangles.
+	*/
+	std::vector<u16> SimplifyMesh(std::vector<Vertex> const& vertices, std::vector<u16> const& indices, u32 targetIndexCount, f32 maxError, f32* error);
+	std::vector<u32> SimplifyMesh(std::vector<Vertex> const& vertices, std::vector<u32> const& indices, u32 targetIndexCount, f32 maxError, f32* error);
+}
@@ -0,0 +1,121 @@
+#include "Header.hpp"
+#include "Meshlet.hpp"
+
+namespace X
+{
+	namespace
+	{
+		template <typename IndexT>
+		void CalculateBounds(std::vector<Vertex> const& vertices, std::vector<IndexT> const& indices, Meshlet* meshlet)
+		{
+			static const f32 FloatMax = std::numeric_limits<f32>::max();
+			f32V3 min(FloatMax, FloatMax, FloatMax);
+			f32V3 max(-FloatMax, -FloatMax, -FloatMax);
+			for (u32 i = meshlet->indexOffset; i < meshlet->indexOffset + meshlet->indexCount; ++i)
+			{
+				f32V3 const& p = vertices[indices[i]].position;
+				min = f32V3(std::min(min.X(), p.X()), std::min(min.Y(), p.Y()), std::min(min.Z(), p.Z()));
+				max = f32V3(std::max(max.X(), p.X()), std::max(max.Y(), p.Y()), std::max(max.Z(), p.Z()));
+			}
+			meshlet->center = (min + max) / 2;
+			f32 radiusSquared = 0;
+			for (u32 i = meshlet->indexOffset; i < meshlet->indexOffset + meshlet->indexCount; ++i)
+			{
+				radiusSquared = std::max(radiusSquared, (vertices[indices[i]].position - meshlet->center).LengthSquared());
+			}
+			meshlet->radius = std::sqrt(radiusSquared);
+
+			// front faces have the geometric normal towards the eye, the same winding the rasterizer tests
+			std::vector<f32V3> normals;
+			normals.reserve(meshlet->indexCount / 3);
+			f32V3 normalSum(0, 0, 0);
+			for (u32 i = meshlet->indexOffset; i < meshlet->indexOffset + meshlet->indexCount; i += 3)
+			{
+				f32V3 const& p0 = vertices[indices[i + 0]].position;
+				f32V3 const& p1 = vertices[indices[i + 1]].position;
+				f32V3 const& p2 = vertices[indices[i + 2]].position;
+				f32V3 normal = Cross(p1 - p0, p2 - p0);
+				if (normal.LengthSquared() == 0)
+				{
+					// degenerate, never rasterized
+					continue;
+				}
+				normals.push_back(Normalize(normal));
+				normalSum = normalSum + normals.back();
+			}
+
+			meshlet->coneAxis = f32V3(0, 0, 1);
+			meshlet->coneCutoff = 1;
+			if (normals.empty() || normalSum.LengthSquared() == 0)
+			{
+				return;
+			}
+			meshlet->coneAxis = Normalize(normalSum);
+			f32 minDot = 1;
+			for (f32V3 const& normal : normals)
+			{
+				minDot = std::min(minDot, Dot(normal, meshlet->coneAxis));
+			}
+			if (minDot > 0)
+			{
+				meshlet->coneCutoff = std::sqrt(1 - minDot * minDot);
+			}
+		}
+
+		template <typename IndexT>
+		std::vector<Meshlet> DoBuildMeshlets(std::vector<Vertex> const& vertices, std::vector<IndexT> const& indices)
+		{
+			assert(indices.size() % 3 == 0);
+			u32 maxVertexCount = Meshlet::MaxVertexCount;
+			u32 maxTriangleCount = Meshlet::MaxTriangleCount;
+
+			std::vector<Meshlet> meshlets;
+			// meshlet a vertex was last counted in, no per meshlet clearing
+			std::vector<u32> vertexMeshlets(vertices.size(), ~0u);
+			u32 vertexCount = 0;
+			Meshlet current;
+			current.indexOffset = 0;
+			current.indexCount = 0;
+			for (u32 i = 0; i < indices.size(); i += 3)
+			{
+				u32 newVertexCount = 0;
+				for (u32 j = 0; j < 3; ++j)
+				{
+					// duplicated index in a degenerate triangle is counted twice, only makes the meshlet a little smaller
+					newVertexCount += vertexMeshlets[indices[i + j]] != meshlets.size() ? 1 : 0;
+				}
+				if (current.indexCount > 0 && (vertexCount + newVertexCount > maxVertexCount || current.indexCount / 3 + 1 > maxTriangleCount))
+				{
+					CalculateBounds(vertices, indices, &current);
+					meshlets.push_back(current);
+					current.indexOffset = i;
+					current.indexCount = 0;
+					vertexCount = 0;
+				}
+				for (u32 j = 0; j < 3; ++j)
+				{
+					if (vertexMeshlets[indices[i + j]] != meshlets.size())
+					{
+						vertexMeshlets[indices[i + j]] = meshlets.size();
+						vertexCount += 1;
+					}
+				}
+				current.indexCount += 3;
+			}
+			if (current.indexCount > 0)
+			{
+				CalculateBounds(vertices, indices, &current);
+				meshlets.push_back(current);
+			}
+			return meshlets;
+		}
+	}
+
+	std::vector<Meshlet> BuildMeshlets(std::vector<Vertex> const& vertices, IndexData const& indices)
+	{
+		return indices.Visit([&vertices] (auto const& typedIndices)
+		{
+			return DoBuildMeshlets(vertices, typedIndices);
+		});
+	}
+}
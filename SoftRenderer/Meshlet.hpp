@@ -0,0 +1,50 @@
+#pragma once
+#include "Common.hpp"
+#include "Primitive.hpp"
+#include "Buffer.hpp"
+
+namespace X
+{
+	/*
+	*	A cluster of consecutive triangles of an index buffer, culled as a whole before any vertex work.
+	*	Bounds are in model space.
+	*/
+	struct Meshlet
+	{
+		static const u32 MaxVertexCount = 64;
+		static const u32 MaxTriangleCount = 124;
+
+		u32 indexOffset;
+		u32 indexCount;
+
+		f32V3 center; // of the bounding sphere
+		f32 radius;
+
+		/*
+		*	Normals of all the triangles are inside the cone of coneAxis, coneCutoff is the sine of its half angle.
+		*	Not culled by facing if the cone is not narrower than a hemisphere, coneCutoff is 1 then.
+		*/
+		f32V3 coneAxis;
+		f32 coneCutoff;
+
+		/*
+		*	@eye: in model space.
+		*	@return: true if every triangle faces away from any eye position, conservative.
+		*/
+		bool IsBackFacing(f32V3 const& eye) const
+		{
+			if (coneCutoff >= 1)
+			{
+				return false;
+			}
+			f32V3 direction = center - eye;
+			return Dot(direction, coneAxis) >= coneCutoff * direction.Length() + radius;
+		}
+	};
+
+	/*
+	*	Partition a triangle list greedily in index order, a meshlet ends when one more triangle exceeds either limit.
+	*	The index buffer is not reordered, every meshlet is a range of it.
+	*/
+	std::vector<Meshlet> BuildMeshlets(std::vector<Vertex> const& vertices, IndexData const& indices);
+}
@@ -17,11 +17,14 @@ namespace X
 			ForwardPreZPass,
 			ForwardRenderPass,
 
-			ForwardTotalRasterize, // accurate only under single thread
+			ForwardTotalRasterize,
+			ForwardLightCulling,
+			ClusteredLightAssignment, // light grid build of either pipeline
+			LightBVHBuild, // of either pipeline
 
 			DeferredLightTransform,
-			DeferredVertex, // accurate only under single thread
-			DeferredRasterizeAndPixel, // accurate only under single thread
+			DeferredVertex,
+			DeferredRasterizeAndPixel,
 
 			TiledFrustumCulling, // accurate only under single thread
 			TiledShading, // accurate only under single thread
@@ -5,7 +5,7 @@
 namespace X
 {
 	Pipeline::Pipeline(Renderer& renderer, Size<u32, 2> const& bufferSize)
-		: renderer_(renderer), bufferSize_(bufferSize)
+		: renderer_(renderer), bufferSize_(bufferSize), vertexProcessingMode_(VertexProcessingMode::Batched)
 	{
 	}
 
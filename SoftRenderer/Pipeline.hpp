@@ -3,15 +3,74 @@
 
 namespace X
 {
+	/*
+	*	Fill rasterizer counters of the last rendered frame.
+	*/
+	struct RasterizerStatistics
+	{
+		u64 acceptedBlockCount;
+		u64 rejectedBlockCount;
+		u64 splitBlockCount;
+		u64 occludedBlockCount;
+	};
+
+	/*
+	*	Vertex stage counters of the last rendered frame.
+	*/
+	struct VertexStatistics
+	{
+		u64 vertexCount; // of all the draws
+		u64 uniqueVertexCount; // distinct vertices shaded
+		u64 shadedVertexCount; // vertex shader invocations, more than unique vertices on post-transform cache misses
+		u64 triangleCount; // of all the draws, after meshlet culling
+	};
+
+	/*
+	*	Triangle culling counters of the last rendered frame, a triangle is counted by the first test rejecting it.
+	*/
+	struct TriangleStatistics
+	{
+		u64 outsideCount; // all vertices outside one frustum plane
+		u64 zeroAreaCount;
+		u64 backFacingCount;
+		u64 subPixelCount; // covering no sample center
+		u64 acceptedCount;
+	};
+
 	class Pipeline
 		: Noncopyable
 	{
+	public:
+		/*
+		*	Batched: every vertex of a draw is shaded before looking at the indices.
+		*	PostTransformCache: triangles are assembled from the indices and only vertices of triangles surviving culling
+		*		are shaded on demand, through a FIFO cache keyed by index like the one of GPUs.
+		*/
+		enum class VertexProcessingMode
+		{
+			Batched,
+			PostTransformCache,
+		};
+
 	public:
 		Pipeline(Renderer& renderer, Size<u32, 2> const& bufferSize);
 		virtual ~Pipeline();
 
 		virtual void RenderScene(f64 current, f32 delta) = 0;
 
+		virtual RasterizerStatistics GetRasterizerStatistics() const = 0;
+		virtual VertexStatistics GetVertexStatistics() const = 0;
+		virtual TriangleStatistics GetTriangleStatistics() const = 0;
+
+		void SetVertexProcessingMode(VertexProcessingMode mode)
+		{
+			vertexProcessingMode_ = mode;
+		}
+		VertexProcessingMode GetVertexProcessingMode() const
+		{
+			return vertexProcessingMode_;
+		}
+
 		Size<u32, 2> GetBufferSize() const
 		{
 			return bufferSize_;
@@ -27,6 +86,8 @@ namespace X
 		Renderer& renderer_;
 
 		Size<u32, 2> bufferSize_;
+
+		VertexProcessingMode vertexProcessingMode_;
 	};
 }
 
@@ -28,6 +28,38 @@ namespace X
 	};
 
 
+	static const u32 FragmentPacketSize = 8;
+
+	/*
+	*	A horizontal run of FragmentPacketSize pixels starting at coordinate.
+	*	Only fragments of the lanes in the active mask passed along with it are valid.
+	*/
+	struct FragmentPacket
+	{
+		Point<u32, 2> coordinate;
+		std::array<AttributeOutputPackage, FragmentPacketSize> fragments;
+		FragmentPacket(Point<u32, 2> const& coordinate)
+			: coordinate(coordinate)
+		{
+		}
+	};
+
+	/*
+	*	For continuations without a vectorized implementation.
+	*	@function: called as function(AttributeOutputPackage const& fragment, Point<u32, 2> sceenCoordinate).
+	*/
+	template <typename FunctionT>
+	inline void ForEachActiveFragment(FragmentPacket const& packet, u32 activeMask, FunctionT const& function)
+	{
+		for (u32 i = 0; i < FragmentPacketSize; ++i)
+		{
+			if ((activeMask & (1u << i)) != 0)
+			{
+				function(packet.fragments[i], Point<u32, 2>(packet.coordinate.X() + i, packet.coordinate.Y()));
+			}
+		}
+	}
+
 	struct Triangle
 	{
 		AttributeOutputPackage& v0;
@@ -0,0 +1,80 @@
+#include "Header.hpp"
+#include "PointLightTable.hpp"
+#include "CPUFeature.hpp"
+
+#include <immintrin.h>
+
+namespace X
+{
+	namespace
+	{
+		static const u32 BatchSize = 8;
+
+		/*
+		*	8 positions transformed in place by the affine matrix.
+		*/
+		void TransformPositionsAVX(f32* x, f32* y, f32* z, f32M44 const& matrix)
+		{
+			__m256 sourceX = _mm256_loadu_ps(x);
+			__m256 sourceY = _mm256_loadu_ps(y);
+			__m256 sourceZ = _mm256_loadu_ps(z);
+			__m256 resultX = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sourceX, _mm256_set1_ps(matrix[0])),
+				_mm256_mul_ps(sourceY, _mm256_set1_ps(matrix[4]))), _mm256_mul_ps(sourceZ, _mm256_set1_ps(matrix[8]))), _mm256_set1_ps(matrix[12]));
+			__m256 resultY = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sourceX, _mm256_set1_ps(matrix[1])),
+				_mm256_mul_ps(sourceY, _mm256_set1_ps(matrix[5]))), _mm256_mul_ps(sourceZ, _mm256_set1_ps(matrix[9]))), _mm256_set1_ps(matrix[13]));
+			__m256 resultZ = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sourceX, _mm256_set1_ps(matrix[2])),
+				_mm256_mul_ps(sourceY, _mm256_set1_ps(matrix[6]))), _mm256_mul_ps(sourceZ, _mm256_set1_ps(matrix[10]))), _mm256_set1_ps(matrix[14]));
+			_mm256_storeu_ps(x, resultX);
+			_mm256_storeu_ps(y, resultY);
+			_mm256_storeu_ps(z, resultZ);
+		}
+	}
+
+	void MakePointLightTable(std::vector<PointLight*> const& pointLights, std::vector<f32V3> const& worldPositions, f32M44 const& viewMatrix, PointLightTable* table)
+	{
+		u32 count = u32(pointLights.size());
+		u32 paddedCount = (count + BatchSize - 1) / BatchSize * BatchSize;
+		PointLightSpheres& spheres = table->spheres;
+		spheres.count = count;
+		spheres.x.assign(paddedCount, 0.f);
+		spheres.y.assign(paddedCount, 0.f);
+		spheres.z.assign(paddedCount, 0.f);
+		spheres.radius.assign(paddedCount, 0.f);
+		table->r.assign(paddedCount, 0.f);
+		table->g.assign(paddedCount, 0.f);
+		table->b.assign(paddedCount, 0.f);
+		table->inverseScaleSquare.assign(paddedCount, 0.f);
+
+		for (u32 i = 0; i < count; ++i)
+		{
+			PointLight const& light = *pointLights[i];
+			spheres.x[i] = worldPositions[i].X();
+			spheres.y[i] = worldPositions[i].Y();
+			spheres.z[i] = worldPositions[i].Z();
+			spheres.radius[i] = light.GetRadius();
+			f32V3 intensity = light.GetLightIntensity();
+			table->r[i] = intensity.X();
+			table->g[i] = intensity.Y();
+			table->b[i] = intensity.Z();
+			table->inverseScaleSquare[i] = light.GetInverseScaleSquare();
+		}
+
+		if (GetCPUFeature().avx)
+		{
+			for (u32 i = 0; i < paddedCount; i += BatchSize)
+			{
+				TransformPositionsAVX(&spheres.x[i], &spheres.y[i], &spheres.z[i], viewMatrix);
+			}
+		}
+		else
+		{
+			for (u32 i = 0; i < count; ++i)
+			{
+				f32V3 position = Transform(f32V3(spheres.x[i], spheres.y[i], spheres.z[i]), viewMatrix);
+				spheres.x[i] = position.X();
+				spheres.y[i] = position.Y();
+				spheres.z[i] = position.Z();
+			}
+		}
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "Common.hpp"
+#include "LightCulling.hpp"
+
+namespace X
+{
+	/*
+	*	Point lights of a frame in structure of arrays form, read by the lighting loops without touching the light components.
+	*	Arrays are padded to a multiple of 8 like the spheres.
+	*/
+	struct PointLightTable
+	{
+		PointLightSpheres spheres; // view space positions and radii
+		// intensity before the falloff
+		std::vector<f32> r;
+		std::vector<f32> g;
+		std::vector<f32> b;
+		std::vector<f32> inverseScaleSquare;
+
+		u32 GetCount() const
+		{
+			return spheres.count;
+		}
+
+		f32V3 GetViewPosition(u32 index) const
+		{
+			return f32V3(spheres.x[index], spheres.y[index], spheres.z[index]);
+		}
+
+		/*
+		*	The same as PointLight::GetLightIntensity.
+		*/
+		f32V3 GetLightIntensity(u32 index, f32V3 const& objectPosition) const
+		{
+			f32 distanceSquared = (GetViewPosition(index) - objectPosition).LengthSquared();
+			return f32V3(r[index], g[index], b[index]) * PointLightFalloff(distanceSquared, spheres.radius[index], inverseScaleSquare[index]);
+		}
+	};
+
+	/*
+	*	Positions are transformed to view space 8 at a time with AVX when supported.
+	*	@worldPositions: of the lights, parallel to pointLights.
+	*	@table: overwritten, its storage is reused when the table is kept between frames.
+	*/
+	void MakePointLightTable(std::vector<PointLight*> const& pointLights, std::vector<f32V3> const& worldPositions, f32M44 const& viewMatrix, PointLightTable* table);
+}
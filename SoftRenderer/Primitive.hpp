@@ -51,6 +51,27 @@ namespace X
 
 	};
 
+	/*
+	*	Compressed Vertex of 16 bytes, decoded to a Vertex on fetch.
+	*	Position is quantized to 16 bits per axis inside the bounds of a VertexQuantization,
+	*	normal is octahedral encoded in 2 snorm16, texture coordinate is 2 half floats.
+	*/
+	struct CompactVertex
+	{
+		std::array<u16, 4> position; // w is unused, keeps the vertex 16 bytes
+		std::array<s16, 2> normal;
+		std::array<u16, 2> textureCoordinate;
+	};
+
+	/*
+	*	position = offset + quantized position * scale
+	*/
+	struct VertexQuantization
+	{
+		f32V3 offset;
+		f32V3 scale;
+	};
+
 	template <>
 	inline Vertex Lerp3<Vertex>(Vertex const& v0, Vertex const& v1, Vertex const& v2, f32 t0, f32 t1, f32 t2)
 	{
@@ -4,6 +4,9 @@
 #include "PipelineDetail.hpp"
 #include "DefferredPipeline.hpp"
 #include "Texture2D.hpp"
+#include "HierarchicalZ.hpp"
+
+#include <ppl.h>
 
 namespace X
 {
@@ -21,14 +24,148 @@ namespace X
 			ContinuationT const& fragmentContinuation, Triangle const& triangle);
 	};
 
+	/*
+	*	Continuation of depth only rasterization, such as a pre-z pass.
+	*	With it only the depth plane is set up and no attribute is interpolated.
+	*/
+	struct DepthOnlyContinuation
+	{
+		void operator() (AttributeOutputPackage const& fragmentInput, Point<u32, 2> sceenCoordinate) const
+		{
+		}
+		void operator() (FragmentPacket const& packet, u32 activeMask) const
+		{
+		}
+	};
+
+	/*
+	*	In Packet mode ContinuationT is also called as operator()(FragmentPacket const& packet, u32 activeMask).
+	*/
 	class FillRasterizer
 		: public Rasterizer
 	{
 	public:
+		enum class Mode
+		{
+			ScanLine,
+			HalfSpace, // incremental integer edge functions over the bounding box, 8 bit sub pixel with top-left fill rule
+			Packet, // half space on packets of FragmentPacketSize pixels, AVX2 when supported
+			Hierarchical, // 8x8 blocks trivially accepted or rejected before the packet coverage test
+		};
+
+		struct BlockStatistics
+		{
+			u64 accepted; // inside the triangle, filled without coverage test
+			u64 rejected; // in the bounding box but outside the triangle
+			u64 split; // partially covered, tested per pixel
+			u64 occluded; // behind the hierarchical z
+		};
+
+	public:
+		explicit FillRasterizer(Mode mode = Mode::ScanLine)
+			: mode_(mode), hierarchicalZ_(nullptr), guardBand_(16), atomicDepth_(false)
+		{
+		}
+
+		void SetMode(Mode mode)
+		{
+			mode_ = mode;
+		}
+		Mode GetMode() const
+		{
+			return mode_;
+		}
+
+		/*
+		*	Used for occlusion culling in Hierarchical mode, must be of the depth buffer rasterized to.
+		*	nullptr to disable.
+		*/
+		void SetHierarchicalZ(HierarchicalZ* hierarchicalZ)
+		{
+			hierarchicalZ_ = hierarchicalZ;
+		}
+		HierarchicalZ* GetHierarchicalZ() const
+		{
+			return hierarchicalZ_;
+		}
+
+		/*
+		*	In multiples of the viewport extent, 16 by default.
+		*	Triangles inside the guard band are rasterized without clipping, the ones crossing it or the near plane are clipped.
+		*	Guard band screen coordinates must stay in the range of the fixed point edge functions (2^22 pixels).
+		*/
+		void SetGuardBand(f32 guardBand)
+		{
+			assert(guardBand >= 1);
+			guardBand_ = guardBand;
+		}
+		f32 GetGuardBand() const
+		{
+			return guardBand_;
+		}
+
+		/*
+		*	Depth test and write by compare and swap, for rasterizing triangles of one depth buffer on several threads
+		*	without owning the pixels. The hierarchical z is not used in this case.
+		*	Continuations are still called concurrently for the same pixel, resolving them is up to the caller.
+		*/
+		void SetAtomicDepth(bool atomicDepth)
+		{
+			atomicDepth_ = atomicDepth;
+		}
+		bool GetAtomicDepth() const
+		{
+			return atomicDepth_;
+		}
+
 		template <typename ContinuationT>
 		void Rasterize(Size<u32, 2> resolution, ConcreteTexture2D<f32>& depthBuffer,
 			ContinuationT const& fragmentContinuation, Triangle const& triangle);
+		/*
+		*	Only pixels inside scissor are touched, used to rasterize a binned tile.
+		*/
+		template <typename ContinuationT>
+		void Rasterize(Size<u32, 2> resolution, ConcreteTexture2D<f32>& depthBuffer,
+			ContinuationT const& fragmentContinuation, Triangle const& triangle, Rectangle<u32> const& scissor);
+		/*
+		*	For a triangle accepted by the triangle culler, the rejection and facing tests are skipped.
+		*	@clipping: flagged by the culler, only then clip codes are calculated and the triangle is clipped.
+		*/
+		template <typename ContinuationT>
+		void RasterizeCulled(Size<u32, 2> resolution, ConcreteTexture2D<f32>& depthBuffer,
+			ContinuationT const& fragmentContinuation, Triangle const& triangle, Rectangle<u32> const& scissor, bool clipping);
+		/*
+		*	Depth only rasterization of a culled triangle given by clip space positions, inside scissor.
+		*/
+		void RasterizeDepth(Size<u32, 2> resolution, ConcreteTexture2D<f32>& depthBuffer,
+			f32V4 const& p0, f32V4 const& p1, f32V4 const& p2, Rectangle<u32> const& scissor, bool clipping);
+
+		/*
+		*	Summed over all threads since the last clear, counted in Hierarchical mode only.
+		*/
+		BlockStatistics GetBlockStatistics() const
+		{
+			return blockStatistics_.combine([] (BlockStatistics const& left, BlockStatistics const& right)
+			{
+				BlockStatistics sum;
+				sum.accepted = left.accepted + right.accepted;
+				sum.rejected = left.rejected + right.rejected;
+				sum.split = left.split + right.split;
+				sum.occluded = left.occluded + right.occluded;
+				return sum;
+			});
+		}
+		void ClearBlockStatistics()
+		{
+			blockStatistics_.clear();
+		}
 
+	private:
+		Mode mode_;
+		HierarchicalZ* hierarchicalZ_;
+		f32 guardBand_;
+		bool atomicDepth_;
+		concurrency::combinable<BlockStatistics> blockStatistics_;
 	};
 }
 
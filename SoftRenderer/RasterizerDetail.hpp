@@ -1,5 +1,10 @@
 #include "Common.hpp"
 #include "Primitive.hpp"
+#include "CPUFeature.hpp"
+
+#include <immintrin.h>
+#include <atomic>
+#include <type_traits>
 
 namespace X
 {
@@ -8,6 +13,44 @@ namespace X
 		template <typename ContinuationT>
 		struct RasterizerDetail
 		{
+			static const s32 SubPixelBits = 8;
+			static const s32 SubPixelScale = 1 << SubPixelBits;
+			// screen coordinates beyond this can not be represented on the fixed point grid
+			static const s32 FixedPointCoordinateLimit = 1 << (30 - SubPixelBits);
+			// block size of the hierarchical fill
+			static const s32 BlockSize = HierarchicalZ::BlockSize;
+			static const f32 HierarchicalZBias;
+			// only depth is written, attributes are neither set up nor interpolated
+			static const bool DepthOnly = std::is_same<ContinuationT, DepthOnlyContinuation>::value;
+
+			FillRasterizer::Mode fillMode;
+			// inclusive pixel bounds of the triangle fill
+			s32 scissorXMin;
+			s32 scissorYMin;
+			s32 scissorXMax;
+			s32 scissorYMax;
+			// used by the hierarchical fill if not null
+			FillRasterizer::BlockStatistics* blockStatistics;
+			HierarchicalZ* hierarchicalZ;
+			// in multiples of the viewport extent in NDC
+			f32 guardBand;
+			// depth test by compare and swap, other threads may rasterize to the same pixels
+			bool atomicDepth;
+
+			RasterizerDetail()
+				: fillMode(FillRasterizer::Mode::ScanLine),
+				scissorXMin(0), scissorYMin(0), scissorXMax(std::numeric_limits<s32>::max()), scissorYMax(std::numeric_limits<s32>::max()),
+				blockStatistics(nullptr), hierarchicalZ(nullptr), guardBand(1), atomicDepth(false)
+			{
+			}
+			RasterizerDetail(FillRasterizer::Mode fillMode, Rectangle<u32> const& scissor, f32 guardBand)
+				: fillMode(fillMode),
+				scissorXMin(s32(scissor.x)), scissorYMin(s32(scissor.y)),
+				scissorXMax(s32(scissor.x + scissor.width) - 1), scissorYMax(s32(scissor.y + scissor.height) - 1),
+				blockStatistics(nullptr), hierarchicalZ(nullptr), guardBand(guardBand), atomicDepth(false)
+			{
+			}
+
 			bool IsFrontFace(Triangle const& triangle)
 			{
 				f32V3 v0 = f32V3(triangle.v0.position.X(), triangle.v0.position.Y(), triangle.v0.position.Z()) / triangle.v0.position.W();
@@ -30,6 +73,43 @@ namespace X
 				}
 			}
 
+			/*
+			*	@return: true if passed and written.
+			*/
+			bool DepthTestAndWrite(ConcreteTexture2D<f32>& depthBuffer, f32 z, Point<u32, 2> sceenCoordinate)
+			{
+				if (atomicDepth)
+				{
+					return AtomicDepthTestAndWrite(depthBuffer.GetValues(0) + sceenCoordinate.Y() * depthBuffer.GetSize(0).X() + sceenCoordinate.X(), z);
+				}
+				if (z <= depthBuffer.GetValue(0, sceenCoordinate))
+				{
+					depthBuffer.SetValue(0, sceenCoordinate, z);
+					return true;
+				}
+				return false;
+			}
+
+			/*
+			*	Lock free, retried until the stored depth is nearer or z is written.
+			*	@return: true if passed and written.
+			*/
+			static bool AtomicDepthTestAndWrite(f32* depth, f32 z)
+			{
+				static_assert(sizeof(std::atomic<u32>) == sizeof(f32), "depth is accessed as atomic bits.");
+				std::atomic<u32>* target = reinterpret_cast<std::atomic<u32>*>(depth);
+				u32 newBits = reinterpret_cast<u32 const&>(z);
+				u32 oldBits = target->load(std::memory_order_relaxed);
+				while (z <= reinterpret_cast<f32 const&>(oldBits))
+				{
+					if (target->compare_exchange_weak(oldBits, newBits, std::memory_order_relaxed))
+					{
+						return true;
+					}
+				}
+				return false;
+			}
+
 			void LineDDA(Size<u32, 2> resolution, ConcreteTexture2D<f32>& depthBuffer,
 				ContinuationT const& fragmentContinuation,
 				AttributeOutputPackage const& v0, AttributeOutputPackage const& v1)
@@ -170,7 +250,7 @@ namespace X
 				f32 rightXMin = std::min(p0.position.X(), p2.position.X());
 				f32 rightXMax = std::max(p0.position.X(), p2.position.X());
 
-				for (s32 y = std::max(yStart, 0); y <= std::min(yEnd, s32(resolution.Y() - 1)); ++y)
+				for (s32 y = std::max(yStart, scissorYMin); y <= std::min(yEnd, scissorYMax); ++y)
 				{
 					f32 lx = Clamp(leftLine.GetX(f32(y)), leftXMin, leftXMax);
 					f32 rx = Clamp(rightLine.GetX(f32(y)), rightXMin, rightXMax);
@@ -178,18 +258,21 @@ namespace X
 					s32 xStart = RoundUp(lx);
 					s32 xEnd = RoundDown(rx);
 
-					for (s32 x = std::max(xStart, 0); x <= std::min(xEnd, s32(resolution.X() - 1)); ++x)
+					for (s32 x = std::max(xStart, scissorXMin); x <= std::min(xEnd, scissorXMax); ++x)
 					{
 						// calculate barycentric coordinates
 						f32 t0 = (deltaY1 * (x - p2.position.X()) - deltaX1 * (y - p2.position.Y())) / denominator;
 						f32 t1 = (deltaY2 * (x - p2.position.X()) - deltaX2 * (y - p2.position.Y())) / denominator;
 						f32 t2 = 1.0f - t0 - t1;
 
-						AttributeOutputPackage v(PerspectiveLerp3InputOverZ(v0OverZ, v1OverZ, v2OverZ, t0, t1, t2));
-						if (v.position.Z() <= 1)
+						f32 z = v0OverZ.position.Z() * t0 + v1OverZ.position.Z() * t1 + v2OverZ.position.Z() * t2;
+						if (z <= 1)
 						{
-							assert(v.position.Z() >= 0);
-							DepthTestAndWrite(depthBuffer, fragmentContinuation, v, Point<u32, 2>(x, y));
+							assert(z >= 0);
+							if (DepthTestAndWrite(depthBuffer, z, Point<u32, 2>(x, y)))
+							{
+								fragmentContinuation(PerspectiveLerp3InputOverZ(v0OverZ, v1OverZ, v2OverZ, t0, t1, t2), Point<u32, 2>(x, y));
+							}
 						}
 
 					}
@@ -319,6 +402,584 @@ namespace X
 				}
 			}
 
+			s32 ToFixedPoint(f32 value)
+			{
+				return static_cast<s32>(std::floor(value * SubPixelScale + 0.5f));
+			}
+
+			bool IsInFixedPointRange(f32V4 const& position)
+			{
+				return std::abs(position.X()) < FixedPointCoordinateLimit && std::abs(position.Y()) < FixedPointCoordinateLimit;
+			}
+
+			/*
+			*	E(x, y) = a * x + b * y + c, on fixed point coordinates.
+			*	Positive at the left side of the edge, i.e. inside of a counter-clockwise triangle.
+			*	Top-left fill rule: c is biased by -1 if the edge is neither a top edge (horizontal, inside at greater y)
+			*	nor a left edge (inside at greater x), so a pixel center exactly on a shared edge belongs to one triangle only.
+			*/
+			struct EdgeFunction
+			{
+				s64 a;
+				s64 b;
+				s64 c;
+				// 0 for top and left edges, -1 otherwise, already added to c
+				s64 bias;
+				// value change of one pixel step
+				s64 xStep;
+				s64 yStep;
+				EdgeFunction()
+				{
+				}
+				EdgeFunction(s32 x0, s32 y0, s32 x1, s32 y1)
+				{
+					a = s64(y0) - y1;
+					b = s64(x1) - x0;
+					bias = a > 0 || (a == 0 && b > 0) ? 0 : -1;
+					c = s64(x0) * y1 - s64(y0) * x1 + bias;
+					xStep = a * SubPixelScale;
+					yStep = b * SubPixelScale;
+				}
+				s64 Evaluate(s32 x, s32 y) const
+				{
+					return a * x + b * y + c;
+				}
+			};
+
+			/*
+			*	A quantity linear in screen space, value at the center of pixel (xMin + dx, yMin + dy).
+			*/
+			struct Plane
+			{
+				f32 origin;
+				f32 ddx;
+				f32 ddy;
+				f32 Evaluate(s32 dx, s32 dy) const
+				{
+					return origin + dy * ddy + dx * ddx;
+				}
+			};
+
+			static const u32 VertexFloatCount = sizeof(Vertex) / sizeof(f32);
+
+			struct HalfSpaceSetup
+			{
+				// z (NDC), 1 / w and attribute / w are linear in screen space
+				Plane z;
+				Plane inverseW;
+				std::array<Plane, VertexFloatCount> vertexOverW;
+				f32 zMin;
+				// each edge function is the weight of the opposite vertex
+				EdgeFunction e12;
+				EdgeFunction e20;
+				EdgeFunction e01;
+				// edge function values at the center of pixel (xMin, yMin)
+				s64 w0Origin;
+				s64 w1Origin;
+				s64 w2Origin;
+				f32 inverseArea;
+				s32 xMin;
+				s32 xMax;
+				s32 yMin;
+				s32 yMax;
+			};
+
+			/*
+			*	Snap vertices to the sub pixel grid, make the triangle counter-clockwise and set up the edge functions.
+			*	@return: false if no pixel can be covered.
+			*/
+			bool SetupHalfSpace(Size<u32, 2> resolution, Triangle const& triangle, HalfSpaceSetup* setup)
+			{
+				AttributeOutputPackage const* pv0 = &triangle.v0;
+				AttributeOutputPackage const* pv1 = &triangle.v1;
+				AttributeOutputPackage const* pv2 = &triangle.v2;
+
+				s32 x0 = ToFixedPoint(pv0->position.X());
+				s32 y0 = ToFixedPoint(pv0->position.Y());
+				s32 x1 = ToFixedPoint(pv1->position.X());
+				s32 y1 = ToFixedPoint(pv1->position.Y());
+				s32 x2 = ToFixedPoint(pv2->position.X());
+				s32 y2 = ToFixedPoint(pv2->position.Y());
+
+				s64 area = (s64(x1) - x0) * (s64(y2) - y0) - (s64(y1) - y0) * (s64(x2) - x0);
+				if (area == 0)
+				{
+					// degenerated triangle
+					return false;
+				}
+				if (area < 0)
+				{
+					// make it counter-clockwise
+					std::swap(pv1, pv2);
+					std::swap(x1, x2);
+					std::swap(y1, y2);
+					area = -area;
+				}
+
+				setup->xMin = std::max(std::min(std::min(x0, x1), x2) >> SubPixelBits, scissorXMin);
+				setup->xMax = std::min(std::max(std::max(x0, x1), x2) >> SubPixelBits, scissorXMax);
+				setup->yMin = std::max(std::min(std::min(y0, y1), y2) >> SubPixelBits, scissorYMin);
+				setup->yMax = std::min(std::max(std::max(y0, y1), y2) >> SubPixelBits, scissorYMax);
+				if (setup->xMin > setup->xMax || setup->yMin > setup->yMax)
+				{
+					return false;
+				}
+
+				setup->e12 = EdgeFunction(x1, y1, x2, y2);
+				setup->e20 = EdgeFunction(x2, y2, x0, y0);
+				setup->e01 = EdgeFunction(x0, y0, x1, y1);
+
+				s32 xCenter = setup->xMin * SubPixelScale + SubPixelScale / 2;
+				s32 yCenter = setup->yMin * SubPixelScale + SubPixelScale / 2;
+				setup->w0Origin = setup->e12.Evaluate(xCenter, yCenter);
+				setup->w1Origin = setup->e20.Evaluate(xCenter, yCenter);
+				setup->w2Origin = setup->e01.Evaluate(xCenter, yCenter);
+
+				setup->inverseArea = 1.f / area;
+
+				setup->z = MakePlane(*setup, pv0->position.Z(), pv1->position.Z(), pv2->position.Z());
+				setup->zMin = std::min(std::min(pv0->position.Z(), pv1->position.Z()), pv2->position.Z());
+				if (DepthOnly)
+				{
+					return true;
+				}
+				setup->inverseW = MakePlane(*setup, pv0->position.W(), pv1->position.W(), pv2->position.W());
+				f32 const* attributes0 = reinterpret_cast<f32 const*>(&pv0->vertex);
+				f32 const* attributes1 = reinterpret_cast<f32 const*>(&pv1->vertex);
+				f32 const* attributes2 = reinterpret_cast<f32 const*>(&pv2->vertex);
+				for (u32 i = 0; i < VertexFloatCount; ++i)
+				{
+					setup->vertexOverW[i] = MakePlane(*setup,
+						attributes0[i] * pv0->position.W(), attributes1[i] * pv1->position.W(), attributes2[i] * pv2->position.W());
+				}
+				return true;
+			}
+
+			/*
+			*	Plane through the values at the three vertices, the edge functions must be set up.
+			*	The fill rule bias is removed so that the barycentric weights sum to one.
+			*/
+			Plane MakePlane(HalfSpaceSetup const& setup, f32 a0, f32 a1, f32 a2)
+			{
+				Plane plane;
+				plane.origin = ((setup.w0Origin - setup.e12.bias) * a0 + (setup.w1Origin - setup.e20.bias) * a1
+					+ (setup.w2Origin - setup.e01.bias) * a2) * setup.inverseArea;
+				plane.ddx = (setup.e12.xStep * a0 + setup.e20.xStep * a1 + setup.e01.xStep * a2) * setup.inverseArea;
+				plane.ddy = (setup.e12.yStep * a0 + setup.e20.yStep * a1 + setup.e01.yStep * a2) * setup.inverseArea;
+				return plane;
+			}
+
+			/*
+			*	Perspective correct attributes of pixel (x, y), only evaluated for fragments passed the depth test.
+			*/
+			AttributeOutputPackage InterpolateHalfSpace(HalfSpaceSetup const& setup, s32 x, s32 y, f32 z)
+			{
+				s32 dx = x - setup.xMin;
+				s32 dy = y - setup.yMin;
+				f32 inverseW = setup.inverseW.Evaluate(dx, dy);
+				f32 w = 1 / inverseW;
+				AttributeOutputPackage output;
+				f32* attributes = reinterpret_cast<f32*>(&output.vertex);
+				for (u32 i = 0; i < VertexFloatCount; ++i)
+				{
+					attributes[i] = setup.vertexOverW[i].Evaluate(dx, dy) * w;
+				}
+				output.position = f32V4(x + 0.5f, y + 0.5f, z, inverseW);
+				return output;
+			}
+
+			/*
+			*	Vertices are snapped to the sub pixel grid, the three edge functions are evaluated at the first pixel center
+			*	of the bounding box and then stepped by adds only.
+			*	Depth is tested first, attributes are interpolated from their planes only for the passed fragments.
+			*/
+			void TriangleHalfSpace(Size<u32, 2> resolution, ConcreteTexture2D<f32>& depthBuffer,
+				ContinuationT const& fragmentContinuation, Triangle const& triangle)
+			{
+				if (!IsInFixedPointRange(triangle.v0.position) || !IsInFixedPointRange(triangle.v1.position) || !IsInFixedPointRange(triangle.v2.position))
+				{
+					TriangleScanLine(resolution, depthBuffer, fragmentContinuation, triangle);
+					return;
+				}
+
+				HalfSpaceSetup setup;
+				if (!SetupHalfSpace(resolution, triangle, &setup))
+				{
+					return;
+				}
+
+				s64 w0Row = setup.w0Origin;
+				s64 w1Row = setup.w1Origin;
+				s64 w2Row = setup.w2Origin;
+				for (s32 y = setup.yMin; y <= setup.yMax; ++y)
+				{
+					s64 w0 = w0Row;
+					s64 w1 = w1Row;
+					s64 w2 = w2Row;
+					for (s32 x = setup.xMin; x <= setup.xMax; ++x)
+					{
+						// no sign bit set, inside all three edges
+						if ((w0 | w1 | w2) >= 0)
+						{
+							f32 z = setup.z.Evaluate(x - setup.xMin, y - setup.yMin);
+							if (z <= 1 && DepthTestAndWrite(depthBuffer, z, Point<u32, 2>(x, y)) && !DepthOnly)
+							{
+								fragmentContinuation(InterpolateHalfSpace(setup, x, y, z), Point<u32, 2>(x, y));
+							}
+						}
+						w0 += setup.e12.xStep;
+						w1 += setup.e20.xStep;
+						w2 += setup.e01.xStep;
+					}
+					w0Row += setup.e12.yStep;
+					w1Row += setup.e20.yStep;
+					w2Row += setup.e01.yStep;
+				}
+			}
+
+			/*
+			*	Edge function offsets of the packet lanes, lanes [0, 4) in low and [4, 8) in high.
+			*/
+			struct PacketEdgeAVX2
+			{
+				__m256i low;
+				__m256i high;
+				void Setup(EdgeFunction const& edge)
+				{
+					low = _mm256_set_epi64x(edge.xStep * 3, edge.xStep * 2, edge.xStep, 0);
+					high = _mm256_set_epi64x(edge.xStep * 7, edge.xStep * 6, edge.xStep * 5, edge.xStep * 4);
+				}
+			};
+
+			/*
+			*	Per triangle state of the packet paths, the lanes are only set up and read with AVX2.
+			*/
+			struct PacketSetup
+			{
+				bool avx2;
+				__m256 dzdxLanes;
+				PacketEdgeAVX2 e12Lanes;
+				PacketEdgeAVX2 e20Lanes;
+				PacketEdgeAVX2 e01Lanes;
+
+				PacketSetup(HalfSpaceSetup const& setup)
+					: avx2(GetCPUFeature().avx2)
+				{
+					if (avx2)
+					{
+						dzdxLanes = _mm256_mul_ps(_mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_ps(setup.z.ddx));
+						e12Lanes.Setup(setup.e12);
+						e20Lanes.Setup(setup.e20);
+						e01Lanes.Setup(setup.e01);
+					}
+				}
+			};
+
+			/*
+			*	w0 w1 w2 are the edge function values of lane 0.
+			*	@return: mask of the lanes inside all three edges.
+			*/
+			u32 CoveragePacket(HalfSpaceSetup const& setup, s64 w0, s64 w1, s64 w2)
+			{
+				u32 coverageMask = 0;
+				for (u32 i = 0; i < FragmentPacketSize; ++i)
+				{
+					if ((w0 | w1 | w2) >= 0)
+					{
+						coverageMask |= 1u << i;
+					}
+					w0 += setup.e12.xStep;
+					w1 += setup.e20.xStep;
+					w2 += setup.e01.xStep;
+				}
+				return coverageMask;
+			}
+
+			u32 CoveragePacketAVX2(PacketSetup const& packetSetup, s64 w0, s64 w1, s64 w2)
+			{
+				__m256i w0Vector = _mm256_set1_epi64x(w0);
+				__m256i w1Vector = _mm256_set1_epi64x(w1);
+				__m256i w2Vector = _mm256_set1_epi64x(w2);
+				__m256i outsideLow = _mm256_or_si256(_mm256_or_si256(_mm256_add_epi64(w0Vector, packetSetup.e12Lanes.low),
+					_mm256_add_epi64(w1Vector, packetSetup.e20Lanes.low)), _mm256_add_epi64(w2Vector, packetSetup.e01Lanes.low));
+				__m256i outsideHigh = _mm256_or_si256(_mm256_or_si256(_mm256_add_epi64(w0Vector, packetSetup.e12Lanes.high),
+					_mm256_add_epi64(w1Vector, packetSetup.e20Lanes.high)), _mm256_add_epi64(w2Vector, packetSetup.e01Lanes.high));
+				// sign bits of the 64 bit lanes
+				u32 outsideMask = _mm256_movemask_pd(_mm256_castsi256_pd(outsideLow)) | (_mm256_movemask_pd(_mm256_castsi256_pd(outsideHigh)) << 4);
+				return ~outsideMask & 0xFF;
+			}
+
+			/*
+			*	Depth of lane i is z + i * dzdx, only lanes in coverageMask are read.
+			*	@return: mask of the lanes passed and written.
+			*/
+			u32 DepthTestAndWritePacket(u32 coverageMask, f32 z, f32 dzdx, f32* depth)
+			{
+				u32 passMask = 0;
+				for (u32 i = 0; i < FragmentPacketSize; ++i)
+				{
+					if ((coverageMask & (1u << i)) != 0)
+					{
+						f32 laneZ = z + i * dzdx;
+						if (laneZ <= 1 && laneZ <= depth[i])
+						{
+							depth[i] = laneZ;
+							passMask |= 1u << i;
+						}
+					}
+				}
+				return passMask;
+			}
+
+			u32 AtomicDepthTestAndWritePacket(u32 coverageMask, f32 z, f32 dzdx, f32* depth)
+			{
+				u32 passMask = 0;
+				for (u32 i = 0; i < FragmentPacketSize; ++i)
+				{
+					if ((coverageMask & (1u << i)) != 0)
+					{
+						f32 laneZ = z + i * dzdx;
+						if (laneZ <= 1 && AtomicDepthTestAndWrite(depth + i, laneZ))
+						{
+							passMask |= 1u << i;
+						}
+					}
+				}
+				return passMask;
+			}
+
+			__m256i VectorMaskFromBits(u32 mask)
+			{
+				__m256i const bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+				return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(mask), bits), bits);
+			}
+
+			u32 DepthTestAndWritePacketAVX2(u32 coverageMask, f32 z, __m256 const& dzdxLanes, f32* depth)
+			{
+				__m256 laneZ = _mm256_add_ps(_mm256_set1_ps(z), dzdxLanes);
+				__m256 oldZ = coverageMask == 0xFF ? _mm256_loadu_ps(depth) : _mm256_maskload_ps(depth, VectorMaskFromBits(coverageMask));
+				__m256 pass = _mm256_and_ps(_mm256_cmp_ps(laneZ, oldZ, _CMP_LE_OQ), _mm256_cmp_ps(laneZ, _mm256_set1_ps(1.f), _CMP_LE_OQ));
+				u32 passMask = _mm256_movemask_ps(pass) & coverageMask;
+				if (passMask != 0)
+				{
+					_mm256_maskstore_ps(depth, VectorMaskFromBits(passMask), laneZ);
+				}
+				return passMask;
+			}
+
+			/*
+			*	Depth test the covered lanes of the packet starting at (x, y), interpolate the passed ones and hand them to the continuation.
+			*	w0 w1 w2 are the edge function values of lane 0.
+			*	@return: mask of the lanes passed.
+			*/
+			u32 ShadePacket(Size<u32, 2> resolution, ConcreteTexture2D<f32>& depthBuffer, ContinuationT const& fragmentContinuation,
+				HalfSpaceSetup const& setup, PacketSetup const& packetSetup, s32 x, s32 y, s64 w0, s64 w1, s64 w2, u32 coverageMask)
+			{
+				f32 z = setup.z.Evaluate(x - setup.xMin, y - setup.yMin);
+				f32* depth = depthBuffer.GetValues(0) + y * resolution.X() + x;
+				u32 passMask = atomicDepth
+					? AtomicDepthTestAndWritePacket(coverageMask, z, setup.z.ddx, depth)
+					: packetSetup.avx2
+					? DepthTestAndWritePacketAVX2(coverageMask, z, packetSetup.dzdxLanes, depth)
+					: DepthTestAndWritePacket(coverageMask, z, setup.z.ddx, depth);
+				if (passMask != 0 && !DepthOnly)
+				{
+					FragmentPacket packet(Point<u32, 2>(x, y));
+					for (u32 i = 0; i < FragmentPacketSize; ++i)
+					{
+						if ((passMask & (1u << i)) != 0)
+						{
+							packet.fragments[i] = InterpolateHalfSpace(setup, x + i, y, z + i * setup.z.ddx);
+						}
+					}
+					fragmentContinuation(packet, passMask);
+				}
+				return passMask;
+			}
+
+			/*
+			*	Same coverage as TriangleHalfSpace, but FragmentPacketSize pixels of a row are tested per iteration and handed
+			*	to the continuation as one packet with an active mask.
+			*	Coverage and depth test use AVX2 when the processor supports it, otherwise the scalar fallback.
+			*/
+			void TrianglePacket(Size<u32, 2> resolution, ConcreteTexture2D<f32>& depthBuffer,
+				ContinuationT const& fragmentContinuation, Triangle const& triangle)
+			{
+				static_assert(FragmentPacketSize == 8, "packet lanes are one ymm register.");
+
+				if (!IsInFixedPointRange(triangle.v0.position) || !IsInFixedPointRange(triangle.v1.position) || !IsInFixedPointRange(triangle.v2.position))
+				{
+					TriangleScanLine(resolution, depthBuffer, fragmentContinuation, triangle);
+					return;
+				}
+
+				HalfSpaceSetup setup;
+				if (!SetupHalfSpace(resolution, triangle, &setup))
+				{
+					return;
+				}
+				PacketSetup packetSetup(setup);
+
+				s64 w0Row = setup.w0Origin;
+				s64 w1Row = setup.w1Origin;
+				s64 w2Row = setup.w2Origin;
+				for (s32 y = setup.yMin; y <= setup.yMax; ++y)
+				{
+					s64 w0 = w0Row;
+					s64 w1 = w1Row;
+					s64 w2 = w2Row;
+					for (s32 x = setup.xMin; x <= setup.xMax; x += FragmentPacketSize)
+					{
+						u32 laneMask = x + s32(FragmentPacketSize) - 1 <= setup.xMax ? 0xFF : (1u << (setup.xMax - x + 1)) - 1;
+						u32 coverageMask = laneMask & (packetSetup.avx2 ? CoveragePacketAVX2(packetSetup, w0, w1, w2) : CoveragePacket(setup, w0, w1, w2));
+						if (coverageMask != 0)
+						{
+							ShadePacket(resolution, depthBuffer, fragmentContinuation, setup, packetSetup, x, y, w0, w1, w2, coverageMask);
+						}
+
+						w0 += setup.e12.xStep * FragmentPacketSize;
+						w1 += setup.e20.xStep * FragmentPacketSize;
+						w2 += setup.e01.xStep * FragmentPacketSize;
+					}
+					w0Row += setup.e12.yStep;
+					w1Row += setup.e20.yStep;
+					w2Row += setup.e01.yStep;
+				}
+			}
+
+			/*
+			*	Smallest and largest value of an edge function over the pixel centers of a block,
+			*	w is the value at the first pixel center of the block.
+			*/
+			s64 BlockMin(EdgeFunction const& edge, s64 w)
+			{
+				return w + std::min<s64>(edge.xStep * (BlockSize - 1), 0) + std::min<s64>(edge.yStep * (BlockSize - 1), 0);
+			}
+			s64 BlockMax(EdgeFunction const& edge, s64 w)
+			{
+				return w + std::max<s64>(edge.xStep * (BlockSize - 1), 0) + std::max<s64>(edge.yStep * (BlockSize - 1), 0);
+			}
+
+			/*
+			*	Coarse pass over screen aligned BlockSize x BlockSize blocks of the bounding box.
+			*	A block outside one edge is rejected, a block inside all three edges is filled without coverage test,
+			*	only the rest is split into packets tested per pixel.
+			*	With a hierarchical z, the triangle and then each block is dropped if its min depth is behind the max depth stored.
+			*/
+			void TriangleHierarchical(Size<u32, 2> resolution, ConcreteTexture2D<f32>& depthBuffer,
+				ContinuationT const& fragmentContinuation, Triangle const& triangle)
+			{
+				static_assert(BlockSize == FragmentPacketSize, "a block row is one packet.");
+
+				if (!IsInFixedPointRange(triangle.v0.position) || !IsInFixedPointRange(triangle.v1.position) || !IsInFixedPointRange(triangle.v2.position))
+				{
+					TriangleScanLine(resolution, depthBuffer, fragmentContinuation, triangle);
+					return;
+				}
+
+				HalfSpaceSetup setup;
+				if (!SetupHalfSpace(resolution, triangle, &setup))
+				{
+					return;
+				}
+				PacketSetup packetSetup(setup);
+
+				// lower bound of the depth of the triangle, biased for the rounding of the depth plane
+				f32 triangleZMin = setup.zMin - HierarchicalZBias;
+				if (hierarchicalZ != nullptr && triangleZMin > hierarchicalZ->GetMaxDepth(setup.xMin, setup.yMin, setup.xMax, setup.yMax))
+				{
+					return;
+				}
+				f32 blockDzMin = std::min(setup.z.ddx * (BlockSize - 1), 0.f) + std::min(setup.z.ddy * (BlockSize - 1), 0.f);
+				s32 updatedBlockXMin = std::numeric_limits<s32>::max();
+				s32 updatedBlockYMin = std::numeric_limits<s32>::max();
+				s32 updatedBlockXMax = -1;
+				s32 updatedBlockYMax = -1;
+
+				u64 accepted = 0;
+				u64 rejected = 0;
+				u64 split = 0;
+				u64 occluded = 0;
+				for (s32 blockY = setup.yMin & ~(BlockSize - 1); blockY <= setup.yMax; blockY += BlockSize)
+				{
+					s32 yBegin = std::max(blockY, setup.yMin);
+					s32 yEnd = std::min(blockY + BlockSize - 1, setup.yMax);
+					for (s32 blockX = setup.xMin & ~(BlockSize - 1); blockX <= setup.xMax; blockX += BlockSize)
+					{
+						s64 w0Block = setup.w0Origin + (blockX - setup.xMin) * setup.e12.xStep + (blockY - setup.yMin) * setup.e12.yStep;
+						s64 w1Block = setup.w1Origin + (blockX - setup.xMin) * setup.e20.xStep + (blockY - setup.yMin) * setup.e20.yStep;
+						s64 w2Block = setup.w2Origin + (blockX - setup.xMin) * setup.e01.xStep + (blockY - setup.yMin) * setup.e01.yStep;
+						if (BlockMax(setup.e12, w0Block) < 0 || BlockMax(setup.e20, w1Block) < 0 || BlockMax(setup.e01, w2Block) < 0)
+						{
+							rejected += 1;
+							continue;
+						}
+						if (hierarchicalZ != nullptr)
+						{
+							f32 blockZ = setup.z.Evaluate(blockX - setup.xMin, blockY - setup.yMin);
+							f32 blockZMin = std::max(blockZ + blockDzMin - HierarchicalZBias, triangleZMin);
+							if (blockZMin > hierarchicalZ->GetBlockMaxDepth(blockX / BlockSize, blockY / BlockSize))
+							{
+								occluded += 1;
+								continue;
+							}
+						}
+						bool inside = BlockMin(setup.e12, w0Block) >= 0 && BlockMin(setup.e20, w1Block) >= 0 && BlockMin(setup.e01, w2Block) >= 0;
+						if (inside)
+						{
+							accepted += 1;
+						}
+						else
+						{
+							split += 1;
+						}
+
+						// columns of the block in the bounding box
+						u32 laneBegin = std::max(blockX, setup.xMin) - blockX;
+						u32 laneEnd = std::min(blockX + BlockSize - 1, setup.xMax) - blockX;
+						u32 laneMask = ((1u << (laneEnd + 1)) - 1) & ~((1u << laneBegin) - 1);
+
+						s64 w0 = w0Block + (yBegin - blockY) * setup.e12.yStep;
+						s64 w1 = w1Block + (yBegin - blockY) * setup.e20.yStep;
+						s64 w2 = w2Block + (yBegin - blockY) * setup.e01.yStep;
+						u32 passMask = 0;
+						for (s32 y = yBegin; y <= yEnd; ++y)
+						{
+							u32 coverageMask = inside ? laneMask
+								: laneMask & (packetSetup.avx2 ? CoveragePacketAVX2(packetSetup, w0, w1, w2) : CoveragePacket(setup, w0, w1, w2));
+							if (coverageMask != 0)
+							{
+								passMask |= ShadePacket(resolution, depthBuffer, fragmentContinuation, setup, packetSetup, blockX, y, w0, w1, w2, coverageMask);
+							}
+							w0 += setup.e12.yStep;
+							w1 += setup.e20.yStep;
+							w2 += setup.e01.yStep;
+						}
+
+						if (hierarchicalZ != nullptr && passMask != 0)
+						{
+							hierarchicalZ->UpdateBlock(blockX / BlockSize, blockY / BlockSize, depthBuffer);
+							updatedBlockXMin = std::min(updatedBlockXMin, blockX / BlockSize);
+							updatedBlockYMin = std::min(updatedBlockYMin, blockY / BlockSize);
+							updatedBlockXMax = std::max(updatedBlockXMax, blockX / BlockSize);
+							updatedBlockYMax = std::max(updatedBlockYMax, blockY / BlockSize);
+						}
+					}
+				}
+
+				if (updatedBlockXMax >= 0)
+				{
+					hierarchicalZ->UpdateTiles(updatedBlockXMin, updatedBlockYMin, updatedBlockXMax, updatedBlockYMax);
+				}
+				if (blockStatistics != nullptr)
+				{
+					blockStatistics->accepted += accepted;
+					blockStatistics->rejected += rejected;
+					blockStatistics->split += split;
+					blockStatistics->occluded += occluded;
+				}
+			}
+
 			/*
 			*	z in [0, 1], w is 1 / input.w, (input.w is z in view space)
 			*/
@@ -338,6 +999,12 @@ namespace X
 				Top = 0x08,
 				Near = 0x10,
 				Far = 0x20,
+				// outside the guard band, also outside the corresponding viewport plane
+				GuardBandLeft = 0x40,
+				GuardBandRight = 0x80,
+				GuardBandBottom = 0x100,
+				GuardBandTop = 0x200,
+				GuardBand = GuardBandLeft | GuardBandRight | GuardBandBottom | GuardBandTop,
 			};
 
 			ClipCode CalculateClipCode(f32V4 const& position)
@@ -367,6 +1034,23 @@ namespace X
 				{
 					code |= ClipCode::Far;
 				}
+				f32 guardBandW = guardBand * position.W();
+				if (position.X() < -guardBandW)
+				{
+					code |= ClipCode::GuardBandLeft;
+				}
+				if (position.X() > guardBandW)
+				{
+					code |= ClipCode::GuardBandRight;
+				}
+				if (position.Y() < -guardBandW)
+				{
+					code |= ClipCode::GuardBandBottom;
+				}
+				if (position.Y() > guardBandW)
+				{
+					code |= ClipCode::GuardBandTop;
+				}
 				return static_cast<ClipCode>(code);
 			}
 
@@ -506,160 +1190,198 @@ namespace X
 			void RasterizeTriangle(Size<u32, 2> resolution, ConcreteTexture2D<f32>& depthBuffer,
 				ContinuationT const& fragmentContinuation, Triangle const& triangle)
 			{
-
 				f32V4 p0 = PerspectiveDivisionAndViewportTransform(resolution, triangle.v0.position);
 				f32V4 p1 = PerspectiveDivisionAndViewportTransform(resolution, triangle.v1.position);
 				f32V4 p2 = PerspectiveDivisionAndViewportTransform(resolution, triangle.v2.position);
 				AttributeOutputPackage v0(triangle.v0.vertex, p0);
 				AttributeOutputPackage v1(triangle.v1.vertex, p1);
 				AttributeOutputPackage v2(triangle.v2.vertex, p2);
-				Triangle newTriangle(v0, v1, v2);
-
-				TriangleScanLine(resolution, depthBuffer, fragmentContinuation, newTriangle);
+				FillTriangle(resolution, depthBuffer, fragmentContinuation, Triangle(v0, v1, v2));
 			}
 
-			void NearClippingRasterize(Size<u32, 2> resolution, ConcreteTexture2D<f32>& depthBuffer,
+			/*
+			*	triangle is in screen space.
+			*/
+			void FillTriangle(Size<u32, 2> resolution, ConcreteTexture2D<f32>& depthBuffer,
 				ContinuationT const& fragmentContinuation, Triangle const& triangle)
 			{
-				AttributeOutputPackage* pv0 = &triangle.v0;
-				AttributeOutputPackage* pv1 = &triangle.v1;
-				AttributeOutputPackage* pv2 = &triangle.v2;
-
-				u32 outsideNearCount = 0;
-				if (pv0->position.Z() < 0)
+				switch (fillMode)
 				{
-					outsideNearCount += 1;
+				case FillRasterizer::Mode::ScanLine:
+					TriangleScanLine(resolution, depthBuffer, fragmentContinuation, triangle);
+					break;
+				case FillRasterizer::Mode::HalfSpace:
+					TriangleHalfSpace(resolution, depthBuffer, fragmentContinuation, triangle);
+					break;
+				case FillRasterizer::Mode::Packet:
+					TrianglePacket(resolution, depthBuffer, fragmentContinuation, triangle);
+					break;
+				case FillRasterizer::Mode::Hierarchical:
+					TriangleHierarchical(resolution, depthBuffer, fragmentContinuation, triangle);
+					break;
+				default:
+					assert(false);
+					break;
 				}
-				if (pv1->position.Z() < 0)
-				{
-					outsideNearCount += 1;
-				}
-				if (pv2->position.Z() < 0)
+			}
+
+			// each clipping plane adds at most one vertex, near and four guard band planes
+			static const u32 MaxClippedVertexCount = 3 + 5;
+
+			struct ClippedPolygon
+			{
+				std::array<AttributeOutputPackage, MaxClippedVertexCount> vertices;
+				u32 count;
+			};
+
+			/*
+			*	Signed distance to the clipping plane in clip space, inside if >= 0.
+			*/
+			f32 ClippingDistance(ClipCode plane, f32V4 const& position)
+			{
+				switch (plane)
 				{
-					outsideNearCount += 1;
+				case ClipCode::Near:
+					return position.Z();
+				case ClipCode::GuardBandLeft:
+					return guardBand * position.W() + position.X();
+				case ClipCode::GuardBandRight:
+					return guardBand * position.W() - position.X();
+				case ClipCode::GuardBandBottom:
+					return guardBand * position.W() + position.Y();
+				case ClipCode::GuardBandTop:
+					return guardBand * position.W() - position.Y();
+				default:
+					assert(false);
+					return 0;
 				}
-				assert(outsideNearCount == 1 || outsideNearCount == 2);
+			}
 
-				if (outsideNearCount == 1)
+			/*
+			*	Sutherland-Hodgman, input and output are convex polygons.
+			*/
+			void ClipPolygon(ClipCode plane, ClippedPolygon const& input, ClippedPolygon* output)
+			{
+				output->count = 0;
+				for (u32 i = 0; i < input.count; ++i)
 				{
-					// 1 vertex outside near, make pv0 point to that vertex
-					if (pv1->position.Z() < 0)
+					AttributeOutputPackage const& current = input.vertices[i];
+					AttributeOutputPackage const& next = input.vertices[i + 1 == input.count ? 0 : i + 1];
+					f32 currentDistance = ClippingDistance(plane, current.position);
+					f32 nextDistance = ClippingDistance(plane, next.position);
+					if (currentDistance >= 0)
 					{
-						pv0 = &triangle.v1;
-						pv1 = &triangle.v2;
-						pv2 = &triangle.v0;
+						output->vertices[output->count++] = current;
 					}
-					else if (pv2->position.Z() < 0)
-					{
-						pv0 = &triangle.v2;
-						pv1 = &triangle.v0;
-						pv2 = &triangle.v1;
-					}
-					else
+					if ((currentDistance >= 0) != (nextDistance >= 0))
 					{
-						// nothing to do
-					}
-					/*
-					* p2---p1
-					* |   /
-					* -------- near(z=0)
-					* | /
-					* |/
-					* p0
-					*/
-					assert(pv1->position.Z() >= 0);
-					assert(pv2->position.Z() >= 0);
-					f32 t1 = (0 - pv1->position.Z()) / (pv0->position.Z() - pv1->position.Z());
-					f32 t2 = (0 - pv2->position.Z()) / (pv0->position.Z() - pv2->position.Z());
-
-					AttributeOutputPackage newP01(Lerp(pv1->vertex, pv0->vertex, t1), Lerp(pv1->position, pv0->position, t1));
-					AttributeOutputPackage newP02(Lerp(pv2->vertex, pv0->vertex, t2), Lerp(pv2->position, pv0->position, t2));
-					Triangle newTriangle0(newP01, *pv1, newP02);
-					Triangle newTriangle1(newP02, *pv1, *pv2);
-
-					if (IsFrontFace(newTriangle0))
-					{
-						RasterizeTriangle(resolution, depthBuffer, fragmentContinuation, newTriangle0);
-						RasterizeTriangle(resolution, depthBuffer, fragmentContinuation, newTriangle1);
+						f32 t = currentDistance / (currentDistance - nextDistance);
+						output->vertices[output->count++] = AttributeOutputPackage(
+							Lerp(current.vertex, next.vertex, t), Lerp(current.position, next.position, t));
 					}
 				}
-				else
+			}
+
+			/*
+			*	Clip against the near plane and the crossed guard band planes into one polygon,
+			*	then project all its vertices once and fill it as a triangle fan.
+			*/
+			void ClipAndRasterize(Size<u32, 2> resolution, ConcreteTexture2D<f32>& depthBuffer,
+				ContinuationT const& fragmentContinuation, Triangle const& triangle, u32 planes)
+			{
+				ClippedPolygon polygons[2];
+				polygons[0].vertices[0] = triangle.v0;
+				polygons[0].vertices[1] = triangle.v1;
+				polygons[0].vertices[2] = triangle.v2;
+				polygons[0].count = 3;
+				u32 current = 0;
+				ClipCode const clippingPlanes[] = { ClipCode::Near,
+					ClipCode::GuardBandLeft, ClipCode::GuardBandRight, ClipCode::GuardBandBottom, ClipCode::GuardBandTop };
+				for (ClipCode plane : clippingPlanes)
 				{
-					// 2 vertices outside near, make pv0 and pv1 point to these two
-					if (pv0->position.Z() >= 0)
+					if ((planes & plane) != 0)
 					{
-						pv0 = &triangle.v1;
-						pv1 = &triangle.v2;
-						pv2 = &triangle.v0;
-					}
-					else if (pv1->position.Z() >= 0)
-					{
-						pv0 = &triangle.v2;
-						pv1 = &triangle.v0;
-						pv2 = &triangle.v1;
-					}
-					else
-					{
-						// nothing to do
-					}
-					/*
-					* p2
-					* |\
-					* | \
-					* -------- near(z=0)
-					* |   \
-					* p0---p1
-					*/
-					assert(pv2->position.Z() >= 0);
-					f32 t0 = (0 - pv2->position.Z()) / (pv0->position.Z() - pv2->position.Z());
-					f32 t1 = (0 - pv2->position.Z()) / (pv1->position.Z() - pv2->position.Z());
-					assert(0 <= t0 && t0 <= 1);
-					assert(0 <= t1 && t1 <= 1);
-
-					AttributeOutputPackage newP0(Lerp(pv2->vertex, pv0->vertex, t0), Lerp(pv2->position, pv0->position, t0));
-					AttributeOutputPackage newP1(Lerp(pv2->vertex, pv1->vertex, t1), Lerp(pv2->position, pv1->position, t1));
-					Triangle newTriangle(newP0, newP1, *pv2);
-					if (IsFrontFace(newTriangle))
-					{
-						RasterizeTriangle(resolution, depthBuffer, fragmentContinuation, newTriangle);
+						ClipPolygon(plane, polygons[current], &polygons[1 - current]);
+						current = 1 - current;
+						if (polygons[current].count < 3)
+						{
+							return;
+						}
 					}
 				}
 
+				ClippedPolygon& polygon = polygons[current];
+				for (u32 i = 0; i < polygon.count; ++i)
+				{
+					polygon.vertices[i].position = PerspectiveDivisionAndViewportTransform(resolution, polygon.vertices[i].position);
+				}
+				// twice the signed area, the same facing test as IsFrontFace
+				f32 area = 0;
+				for (u32 i = 0; i < polygon.count; ++i)
+				{
+					f32V4 const& p0 = polygon.vertices[i].position;
+					f32V4 const& p1 = polygon.vertices[i + 1 == polygon.count ? 0 : i + 1].position;
+					area += p0.X() * p1.Y() - p0.Y() * p1.X();
+				}
+				if (!(area < 0))
+				{
+					return;
+				}
+				for (u32 i = 2; i < polygon.count; ++i)
+				{
+					FillTriangle(resolution, depthBuffer, fragmentContinuation,
+						Triangle(polygon.vertices[0], polygon.vertices[i - 1], polygon.vertices[i]));
+				}
 			}
 
+			/*
+			*	Triangles inside the guard band go to setup directly, the fill is bounded by the viewport and rejects depth beyond far per pixel.
+			*	Only triangles crossing the near plane or the guard band are clipped.
+			*/
 			void ClippingRasterizeFill(Size<u32, 2> resolution, ConcreteTexture2D<f32>& depthBuffer,
 				ContinuationT const& fragmentContinuation, Triangle const& triangle)
 			{
 				ClipCode cc0 = CalculateClipCode(triangle.v0.position);
 				ClipCode cc1 = CalculateClipCode(triangle.v1.position);
 				ClipCode cc2 = CalculateClipCode(triangle.v2.position);
-				if ((cc0 | cc1 | cc2) == 0)
+				u32 clippingPlanes = (cc0 | cc1 | cc2) & (ClipCode::Near | ClipCode::GuardBand);
+				if ((cc0 & cc1 & cc2) != 0)
+				{
+					// outside one of the planes, reject, nothing to do
+				}
+				else if (clippingPlanes == 0)
 				{
 					if (IsFrontFace(triangle))
 					{
-						// inside, accept
+						// inside the guard band, accept
 						RasterizeTriangle(resolution, depthBuffer, fragmentContinuation, triangle);
 					}
 				}
-				else if ((cc0 & cc1 & cc2) > 0)
-				{
-					// outside all the planes, reject, nothing to do
-				}
-				else if (((cc0 | cc1 | cc2) & ClipCode::Near) != 0)
+				else
 				{
-					// clip with near plane
-					NearClippingRasterize(resolution, depthBuffer, fragmentContinuation, triangle);
+					ClipAndRasterize(resolution, depthBuffer, fragmentContinuation, triangle, clippingPlanes);
 				}
-				else
+			}
+
+			/*
+			*	The triangle culler already rejected triangles outside, back facing or of zero area.
+			*/
+			void CulledRasterizeFill(Size<u32, 2> resolution, ConcreteTexture2D<f32>& depthBuffer,
+				ContinuationT const& fragmentContinuation, Triangle const& triangle, bool clipping)
+			{
+				if (!clipping)
 				{
-					if (IsFrontFace(triangle))
-					{
-						// intersect with other planes, accept
-						RasterizeTriangle(resolution, depthBuffer, fragmentContinuation, triangle);
-					}
+					RasterizeTriangle(resolution, depthBuffer, fragmentContinuation, triangle);
+					return;
 				}
+				u32 clippingPlanes = (CalculateClipCode(triangle.v0.position) | CalculateClipCode(triangle.v1.position) | CalculateClipCode(triangle.v2.position))
+					& (ClipCode::Near | ClipCode::GuardBand);
+				ClipAndRasterize(resolution, depthBuffer, fragmentContinuation, triangle, clippingPlanes);
 			}
 		};
+
+		template <typename ContinuationT>
+		f32 const RasterizerDetail<ContinuationT>::HierarchicalZBias = 1e-5f;
 	}
 
 	template <typename ContinuationT>
@@ -674,6 +1396,48 @@ namespace X
 	void FillRasterizer::Rasterize(Size<u32, 2> resolution, ConcreteTexture2D<f32>& depthBuffer,
 		ContinuationT const& fragmentContinuation, Triangle const& triangle)
 	{
-		Detail::RasterizerDetail<ContinuationT>().ClippingRasterizeFill(resolution, depthBuffer, fragmentContinuation, triangle);
+		Rasterize(resolution, depthBuffer, fragmentContinuation, triangle, Rectangle<u32>(0, 0, resolution.X(), resolution.Y()));
+	}
+
+	template <typename ContinuationT>
+	void FillRasterizer::Rasterize(Size<u32, 2> resolution, ConcreteTexture2D<f32>& depthBuffer,
+		ContinuationT const& fragmentContinuation, Triangle const& triangle, Rectangle<u32> const& scissor)
+	{
+		assert(scissor.x + scissor.width <= resolution.X() && scissor.y + scissor.height <= resolution.Y());
+		Detail::RasterizerDetail<ContinuationT> detail(mode_, scissor, guardBand_);
+		detail.atomicDepth = atomicDepth_;
+		if (mode_ == Mode::Hierarchical)
+		{
+			detail.blockStatistics = &blockStatistics_.local();
+			// block max depth can not be updated atomically
+			detail.hierarchicalZ = atomicDepth_ ? nullptr : hierarchicalZ_;
+		}
+		detail.ClippingRasterizeFill(resolution, depthBuffer, fragmentContinuation, triangle);
+	}
+
+	template <typename ContinuationT>
+	void FillRasterizer::RasterizeCulled(Size<u32, 2> resolution, ConcreteTexture2D<f32>& depthBuffer,
+		ContinuationT const& fragmentContinuation, Triangle const& triangle, Rectangle<u32> const& scissor, bool clipping)
+	{
+		assert(scissor.x + scissor.width <= resolution.X() && scissor.y + scissor.height <= resolution.Y());
+		Detail::RasterizerDetail<ContinuationT> detail(mode_, scissor, guardBand_);
+		detail.atomicDepth = atomicDepth_;
+		if (mode_ == Mode::Hierarchical)
+		{
+			detail.blockStatistics = &blockStatistics_.local();
+			detail.hierarchicalZ = atomicDepth_ ? nullptr : hierarchicalZ_;
+		}
+		detail.CulledRasterizeFill(resolution, depthBuffer, fragmentContinuation, triangle, clipping);
+	}
+
+	inline void FillRasterizer::RasterizeDepth(Size<u32, 2> resolution, ConcreteTexture2D<f32>& depthBuffer,
+		f32V4 const& p0, f32V4 const& p1, f32V4 const& p2, Rectangle<u32> const& scissor, bool clipping)
+	{
+		// attributes are only carried through clipping, never read
+		Vertex empty(f32V3(0, 0, 0), f32V3(0, 0, 0), f32V2(0, 0));
+		AttributeOutputPackage v0(empty, p0);
+		AttributeOutputPackage v1(empty, p1);
+		AttributeOutputPackage v2(empty, p2);
+		RasterizeCulled(resolution, depthBuffer, DepthOnlyContinuation(), Triangle(v0, v1, v2), scissor, clipping);
 	}
 }
\ No newline at end of file
@@ -10,12 +10,22 @@ namespace X
 		Renderable* renderable;
 		std::shared_ptr<GeometryLayout> layout;
 		std::shared_ptr<Material> material;
+		IndexData indices; // triangles of the meshlets not culled, empty to draw the whole index buffer of layout
+		std::vector<f32M44> instances; // model matrices of the instances not culled, relative to the renderable, empty if not instanced
 		RenderablePackage(Renderable& renderable, std::shared_ptr<GeometryLayout> layout, std::shared_ptr<Material> material)
 			: renderable(&renderable), layout(layout), material(std::move(material))
 		{
 		}
+		RenderablePackage(Renderable& renderable, std::shared_ptr<GeometryLayout> layout, std::shared_ptr<Material> material, IndexData indices)
+			: renderable(&renderable), layout(layout), material(std::move(material)), indices(std::move(indices))
+		{
+		}
+		RenderablePackage(Renderable& renderable, std::shared_ptr<GeometryLayout> layout, std::shared_ptr<Material> material, std::vector<f32M44> instances)
+			: renderable(&renderable), layout(layout), material(std::move(material)), instances(std::move(instances))
+		{
+		}
 		RenderablePackage(RenderablePackage&& right)
-			: renderable(right.renderable), layout(right.layout), material(std::move(right.material))
+			: renderable(right.renderable), layout(right.layout), material(std::move(right.material)), indices(std::move(right.indices)), instances(std::move(right.instances))
 		{
 		}
 		RenderablePackage& operator =(RenderablePackage&& right)
@@ -23,6 +33,9 @@ namespace X
 			renderable = right.renderable;
 			layout = std::move(right.layout);
 			material = std::move(right.material);
+			indices = std::move(right.indices);
+			instances = std::move(right.instances);
+			return *this;
 		}
 	};
 
@@ -39,6 +52,11 @@ namespace X
 		{
 			return packages_;
 		}
+		// for taking the packages over before Clear
+		std::vector<RenderablePackage>& GetAllPackages()
+		{
+			return packages_;
+		}
 
 		void Clear()
 		{
@@ -60,7 +78,10 @@ namespace X
 			return ComponentType::Renderable;
 		}
 
-		virtual void GetRenderablePackage(RenderablePackCollector& collector, Frustum const& frustum, f32M44 const& worldViewMatrix) = 0;
+		/*
+		*	@pixelScale: pixels covered by a view space length of 1 at distance 1, for level of detail selection.
+		*/
+		virtual void GetRenderablePackage(RenderablePackCollector& collector, Frustum const& frustum, f32M44 const& worldViewMatrix, f32 pixelScale) = 0;
 
 		virtual BoundingBox GetBoundingBox() = 0;
 
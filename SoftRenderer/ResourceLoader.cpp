@@ -3,6 +3,7 @@
 #include "Mesh.hpp"
 #include "Material.hpp"
 #include "GeometryLayout.hpp"
+#include "MeshOptimizer.hpp"
 
 #include "FreeImage.h"
 #include "assimp/Importer.hpp"
@@ -66,8 +67,13 @@ namespace X
 	{
 		std::tr2::sys::path rootPath;
 		std::vector<std::tr2::sys::path> paths;
+		bool optimizeMeshes;
+		MeshOptimizationStatistics meshOptimizationStatistics;
+		bool compressVertices;
+		bool buildLevels;
 		Impl(std::string root)
-			: rootPath(std::tr2::sys::system_complete(std::tr2::sys::path(std::move(root))))
+			: rootPath(std::tr2::sys::system_complete(std::tr2::sys::path(std::move(root)))), optimizeMeshes(false), meshOptimizationStatistics(),
+			compressVertices(false), buildLevels(false)
 		{
 			assert(std::tr2::sys::exists(rootPath) && std::tr2::sys::is_directory(rootPath));
 			paths.push_back(rootPath);
@@ -246,6 +252,8 @@ namespace X
 	{
 		struct SceneProcessor
 		{
+			static const u32 MaxLevelCount = 6;
+
 			ResourceLoader& loader_;
 
 			aiScene const& scene_;
@@ -258,8 +266,13 @@ namespace X
 			std::vector<std::shared_ptr<Material>> createdMaterials_;
 			std::vector<std::shared_ptr<GeometryLayout>> createdLayouts_;
 
-			SceneProcessor(ResourceLoader& loader, aiScene const& theScene, std::string const& filePath)
-				: loader_(loader), scene_(theScene)
+			bool buildMeshlets_;
+			bool buildLevels_;
+			bool optimize_;
+			MeshOptimizationStatistics optimizationStatistics_;
+
+			SceneProcessor(ResourceLoader& loader, aiScene const& theScene, std::string const& filePath, bool buildMeshlets, bool buildLevels, bool optimize, bool compress)
+				: loader_(loader), scene_(theScene), buildMeshlets_(buildMeshlets), buildLevels_(buildLevels), optimize_(optimize), optimizationStatistics_()
 			{
 				std::tr2::sys::path scenePath(filePath);
 				directoryPath_ = scenePath.parent_path().string() + "/";
@@ -267,6 +280,11 @@ namespace X
 				sampler_ = std::make_shared<PointSampler<Sampler::RepeatAddresser>>();
 				ProcessScene();
 				result_->CalculateBoundingBox();
+				if (compress)
+				{
+					// meshlets are built already, quantized inside the bounding boxes
+					result_->CompressVertices();
+				}
 			}
 
 			void ProcessScene()
@@ -462,25 +480,21 @@ namespace X
 							// vertex colors are ignored
 						}
 					}
-					std::shared_ptr<VertexBuffer> vertexBuffer = std::make_shared<VertexBuffer>(std::move(vertices));
 
-					std::vector<u16> indices;
 					s32 indicesPerFace = mesh->mFaces[0].mNumIndices;
 					assert(indicesPerFace == 3);
-					if (mesh->mNumVertices > static_cast<u32>(std::numeric_limits<u16>::max()))
+					// 16 bit unless some vertex index does not fit
+					IndexData indices;
+					if (mesh->mNumVertices <= static_cast<u32>(std::numeric_limits<u16>::max()) + 1)
 					{
-						assert(false);
+						indices = ProcessIndices<u16>(*mesh, &vertices);
 					}
-					indices.resize(mesh->mNumFaces * indicesPerFace);
-					for (u32 j = 0; j < mesh->mNumFaces; ++j)
+					else
 					{
-						aiFace& face = mesh->mFaces[j];
-						assert(face.mNumIndices == indicesPerFace);
-						for (int k = 0; k < indicesPerFace; ++k)
-						{
-							indices[j * indicesPerFace + k] = static_cast<u16>(face.mIndices[k]);
-						}
+						indices = ProcessIndices<u32>(*mesh, &vertices);
 					}
+
+					std::shared_ptr<VertexBuffer> vertexBuffer = std::make_shared<VertexBuffer>(std::move(vertices));
 					std::shared_ptr<IndexBuffer> indexBuffer = std::make_shared<IndexBuffer>(std::move(indices));
 
 
@@ -503,12 +517,51 @@ namespace X
 					assert(mesh->mPrimitiveTypes == aiPrimitiveType::aiPrimitiveType_TRIANGLE);
 
 					createdLayouts_[i] = std::make_shared<GeometryLayout>(vertexBuffer, indexBuffer);
+					if (buildLevels_)
+					{
+						createdLayouts_[i]->BuildLevels(MaxLevelCount);
+					}
+					if (buildMeshlets_)
+					{
+						createdLayouts_[i]->BuildMeshlets();
+						for (GeometryLayout::Level const& level : createdLayouts_[i]->GetLevels())
+						{
+							level.layout->BuildMeshlets();
+						}
+					}
 
 
 				}
 			}
 
 
+			/*
+			*	Faces to a triangle list of IndexT, optimized together with the vertices if enabled.
+			*/
+			template <typename IndexT>
+			IndexData ProcessIndices(aiMesh const& mesh, std::vector<Vertex>* vertices)
+			{
+				std::vector<IndexT> indices(mesh.mNumFaces * 3);
+				for (u32 j = 0; j < mesh.mNumFaces; ++j)
+				{
+					aiFace& face = mesh.mFaces[j];
+					assert(face.mNumIndices == 3);
+					for (u32 k = 0; k < 3; ++k)
+					{
+						indices[j * 3 + k] = static_cast<IndexT>(face.mIndices[k]);
+					}
+				}
+
+				if (optimize_)
+				{
+					optimizationStatistics_.triangleCount += indices.size() / 3;
+					optimizationStatistics_.shadedVertexCountBefore += CountShadedVertices(indices);
+					OptimizeMesh(vertices, &indices);
+					optimizationStatistics_.shadedVertexCountAfter += CountShadedVertices(indices);
+				}
+				return IndexData(std::move(indices));
+			}
+
 			void ProcessNode(aiNode const& node)
 			{
 				u32* meshIndices = node.mMeshes;
@@ -529,7 +582,7 @@ namespace X
 
 	}
 
-	std::unique_ptr<Mesh> ResourceLoader::LoadMesh(std::string const& path)
+	std::unique_ptr<Mesh> ResourceLoader::LoadMesh(std::string const& path, bool buildMeshlets)
 	{
 		std::string locatedPath;
 		if (!LocatePathString(impl->paths, false, path, &locatedPath))
@@ -552,7 +605,44 @@ namespace X
 			return nullptr;
 		}
 		// Everything will be cleaned up by the importer destructor
-		return SceneProcessor(*this, *scene, locatedPath).result_;
+		SceneProcessor processor(*this, *scene, locatedPath, buildMeshlets, impl->buildLevels, impl->optimizeMeshes, impl->compressVertices);
+		impl->meshOptimizationStatistics = processor.optimizationStatistics_;
+		return std::move(processor.result_);
+	}
+
+	void ResourceLoader::SetMeshOptimization(bool optimize)
+	{
+		impl->optimizeMeshes = optimize;
+	}
+
+	bool ResourceLoader::GetMeshOptimization() const
+	{
+		return impl->optimizeMeshes;
+	}
+
+	MeshOptimizationStatistics ResourceLoader::GetMeshOptimizationStatistics() const
+	{
+		return impl->meshOptimizationStatistics;
+	}
+
+	void ResourceLoader::SetVertexCompression(bool compress)
+	{
+		impl->compressVertices = compress;
+	}
+
+	bool ResourceLoader::GetVertexCompression() const
+	{
+		return impl->compressVertices;
+	}
+
+	void ResourceLoader::SetLevelOfDetailGeneration(bool generate)
+	{
+		impl->buildLevels = generate;
+	}
+
+	bool ResourceLoader::GetLevelOfDetailGeneration() const
+	{
+		return impl->buildLevels;
 	}
 
 }
@@ -4,6 +4,17 @@
 
 namespace X
 {
+	/*
+	*	Mesh optimizer counters of the last loaded mesh, summed over its geometry layouts.
+	*	Shaded vertices divided by triangles is the average cache miss ratio (ACMR) of the post-transform cache.
+	*/
+	struct MeshOptimizationStatistics
+	{
+		u64 triangleCount;
+		u64 shadedVertexCountBefore;
+		u64 shadedVertexCountAfter;
+	};
+
 	class ResourceLoader
 	{
 	public:
@@ -13,7 +24,32 @@ namespace X
 		bool AddResourceLocation(std::string path);
 
 		std::shared_ptr<ConcreteTexture2D<f32V3>> LoadTexture(std::string const& path);
-		std::unique_ptr<Mesh> LoadMesh(std::string const& path);
+		/*
+		*	@buildMeshlets: partition every geometry layout into meshlets for culling.
+		*/
+		std::unique_ptr<Mesh> LoadMesh(std::string const& path, bool buildMeshlets = false);
+
+		/*
+		*	Reorder index and vertex buffers of loaded meshes for the post-transform cache, overdraw and vertex fetch,
+		*	before meshlets are built.
+		*/
+		void SetMeshOptimization(bool optimize);
+		bool GetMeshOptimization() const;
+		MeshOptimizationStatistics GetMeshOptimizationStatistics() const;
+
+		/*
+		*	Store vertex buffers of loaded meshes as CompactVertex, half the memory of Vertex, decoded in the vertex fetch.
+		*	Positions are quantized to 16 bits inside the bounding box of the sub mesh, normals and texture coordinates lose precision too.
+		*/
+		void SetVertexCompression(bool compress);
+		bool GetVertexCompression() const;
+
+		/*
+		*	Build a chain of simplified levels for every geometry layout of loaded meshes, after mesh optimization.
+		*	Meshlets, if requested, are built for the levels too.
+		*/
+		void SetLevelOfDetailGeneration(bool generate);
+		bool GetLevelOfDetailGeneration() const;
 
 	private:
 		struct Impl;
@@ -0,0 +1,135 @@
+#include "Header.hpp"
+#include "TileBinner.hpp"
+
+namespace X
+{
+	TileBinner::TileBinner(Size<u32, 2> const& resolution)
+		: resolution_(resolution),
+		tileCount_((resolution.X() + TileSize - 1) / TileSize, (resolution.Y() + TileSize - 1) / TileSize)
+	{
+	}
+
+	Rectangle<u32> TileBinner::GetTileRectangle(u32 tileIndex) const
+	{
+		u32 x = tileIndex % tileCount_.X() * TileSize;
+		u32 y = tileIndex / tileCount_.X() * TileSize;
+		u32 tileSize = TileSize;
+		return Rectangle<u32>(x, y, std::min(tileSize, resolution_.X() - x), std::min(tileSize, resolution_.Y() - y));
+	}
+
+	namespace
+	{
+		f32V4 const& PositionOf(AttributeOutputPackage const& vertex)
+		{
+			return vertex.position;
+		}
+		f32V4 const& PositionOf(f32V4 const& position)
+		{
+			return position;
+		}
+	}
+
+	void TileBinner::Bin(std::vector<AttributeOutputPackage> const& vertices, IndexData const& indices, u32 vertexCount, VisibleTriangles const& visible, TileBins* bins) const
+	{
+		indices.Visit([&] (auto const& typedIndices)
+		{
+			DoBin(vertices, typedIndices, vertexCount, visible, bins);
+		});
+	}
+
+	void TileBinner::Bin(std::vector<f32V4> const& positions, IndexData const& indices, u32 vertexCount, VisibleTriangles const& visible, TileBins* bins) const
+	{
+		indices.Visit([&] (auto const& typedIndices)
+		{
+			DoBin(positions, typedIndices, vertexCount, visible, bins);
+		});
+	}
+
+	template <typename VertexT, typename IndexT>
+	void TileBinner::DoBin(std::vector<VertexT> const& vertices, std::vector<IndexT> const& indices, u32 vertexCount, VisibleTriangles const& visible, TileBins* bins) const
+	{
+		assert(indices.size() % 3 == 0);
+		u32 instanceTriangleCount = indices.size() / 3;
+		u32 triangleCount = visible.triangles.size();
+		u32 tileCount = GetTileCount();
+
+		TileBins::TileRange const empty = { 1, 1, 0, 0 };
+		TileBins::TileRange const all = { 0, 0, tileCount_.X() - 1, tileCount_.Y() - 1 };
+
+		bins->triangleRanges.resize(triangleCount);
+		bins->tileOffsets.assign(tileCount + 1, 0);
+		for (u32 i = 0; i < triangleCount; ++i)
+		{
+			// outside, back facing and empty triangles are already culled
+			u32 instance = visible.triangles[i] / instanceTriangleCount;
+			u32 triangle = visible.triangles[i] - instance * instanceTriangleCount;
+			VertexT const* instanceVertices = vertices.data() + instance * vertexCount;
+			f32V4 const& p0 = PositionOf(instanceVertices[indices[triangle * 3 + 0]]);
+			f32V4 const& p1 = PositionOf(instanceVertices[indices[triangle * 3 + 1]]);
+			f32V4 const& p2 = PositionOf(instanceVertices[indices[triangle * 3 + 2]]);
+
+			TileBins::TileRange& range = bins->triangleRanges[i];
+			if (p0.Z() < 0 || p1.Z() < 0 || p2.Z() < 0)
+			{
+				// crossing the near plane, screen bounds are only known after clipping
+				range = all;
+			}
+			else
+			{
+				f32 x0 = (p0.X() / p0.W() * 0.5f + 0.5f) * resolution_.X();
+				f32 y0 = (p0.Y() / p0.W() * 0.5f + 0.5f) * resolution_.Y();
+				f32 x1 = (p1.X() / p1.W() * 0.5f + 0.5f) * resolution_.X();
+				f32 y1 = (p1.Y() / p1.W() * 0.5f + 0.5f) * resolution_.Y();
+				f32 x2 = (p2.X() / p2.W() * 0.5f + 0.5f) * resolution_.X();
+				f32 y2 = (p2.Y() / p2.W() * 0.5f + 0.5f) * resolution_.Y();
+				// one pixel margin for snapping in the rasterizer
+				f32 xMin = std::min(std::min(x0, x1), x2) - 1;
+				f32 xMax = std::max(std::max(x0, x1), x2) + 1;
+				f32 yMin = std::min(std::min(y0, y1), y2) - 1;
+				f32 yMax = std::max(std::max(y0, y1), y2) + 1;
+				if (!(xMin < resolution_.X() && xMax >= 0 && yMin < resolution_.Y() && yMax >= 0))
+				{
+					// off screen or not a number
+					range = empty;
+					continue;
+				}
+				range.xMin = u32(std::max(xMin, 0.f)) / TileSize;
+				range.yMin = u32(std::max(yMin, 0.f)) / TileSize;
+				range.xMax = u32(std::min(xMax, f32(resolution_.X() - 1))) / TileSize;
+				range.yMax = u32(std::min(yMax, f32(resolution_.Y() - 1))) / TileSize;
+			}
+
+			for (u32 y = range.yMin; y <= range.yMax; ++y)
+			{
+				for (u32 x = range.xMin; x <= range.xMax; ++x)
+				{
+					bins->tileOffsets[y * tileCount_.X() + x + 1] += 1;
+				}
+			}
+		}
+
+		for (u32 i = 0; i < tileCount; ++i)
+		{
+			bins->tileOffsets[i + 1] += bins->tileOffsets[i];
+		}
+		bins->triangles.resize(bins->tileOffsets[tileCount]);
+
+		// fill in submission order, tileOffsets[i] is used as cursor of tile i and restored after
+		for (u32 i = 0; i < triangleCount; ++i)
+		{
+			TileBins::TileRange const& range = bins->triangleRanges[i];
+			for (u32 y = range.yMin; y <= range.yMax; ++y)
+			{
+				for (u32 x = range.xMin; x <= range.xMax; ++x)
+				{
+					bins->triangles[bins->tileOffsets[y * tileCount_.X() + x]++] = i;
+				}
+			}
+		}
+		for (u32 i = tileCount; i > 0; --i)
+		{
+			bins->tileOffsets[i] = bins->tileOffsets[i - 1];
+		}
+		bins->tileOffsets[0] = 0;
+	}
+}
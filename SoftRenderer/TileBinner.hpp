@@ -0,0 +1,73 @@
+#pragma once
+#include "Common.hpp"
+#include "PipelineDetail.hpp"
+#include "TriangleCuller.hpp"
+#include "Buffer.hpp"
+
+namespace X
+{
+	/*
+	*	Visible triangles of one draw sorted into screen tiles.
+	*	Triangles of tile i are triangles[tileOffsets[i], tileOffsets[i + 1]), in submission order.
+	*/
+	struct TileBins
+	{
+		struct TileRange
+		{
+			u32 xMin;
+			u32 yMin;
+			u32 xMax;
+			u32 yMax;
+
+			bool IsEmpty() const
+			{
+				return xMin > xMax;
+			}
+		};
+
+		std::vector<u32> tileOffsets;
+		std::vector<u32> triangles; // position in VisibleTriangles::triangles
+		std::vector<TileRange> triangleRanges; // per visible triangle, empty if off screen
+	};
+
+	/*
+	*	Sort-middle binning of post-transform triangles. Each tile is rasterized by exactly one worker,
+	*	so depth test and fragment write need no synchronization and the result is the same as the serial order.
+	*/
+	class TileBinner
+		: Noncopyable
+	{
+	public:
+		static const u32 TileSize = 64;
+
+	public:
+		explicit TileBinner(Size<u32, 2> const& resolution);
+
+		u32 GetTileCount() const
+		{
+			return tileCount_.X() * tileCount_.Y();
+		}
+		Rectangle<u32> GetTileRectangle(u32 tileIndex) const;
+
+		/*
+		*	@vertices: clip space post-transform vertices.
+		*	@indices: triangle list.
+		*	@vertexCount: of one instance, the same as given to the triangle culler.
+		*	@visible: of the triangle culler, only these triangles are binned.
+		*	@bins: storage reused between frames.
+		*/
+		void Bin(std::vector<AttributeOutputPackage> const& vertices, IndexData const& indices, u32 vertexCount, VisibleTriangles const& visible, TileBins* bins) const;
+		/*
+		*	@positions: clip space positions, of a position only transform.
+		*/
+		void Bin(std::vector<f32V4> const& positions, IndexData const& indices, u32 vertexCount, VisibleTriangles const& visible, TileBins* bins) const;
+
+	private:
+		template <typename VertexT, typename IndexT>
+		void DoBin(std::vector<VertexT> const& vertices, std::vector<IndexT> const& indices, u32 vertexCount, VisibleTriangles const& visible, TileBins* bins) const;
+
+	private:
+		Size<u32, 2> resolution_;
+		Size<u32, 2> tileCount_;
+	};
+}
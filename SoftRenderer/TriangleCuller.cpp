@@ -0,0 +1,369 @@
+#include "Header.hpp"
+#include "TriangleCuller.hpp"
+#include "CPUFeature.hpp"
+
+#include <immintrin.h>
+
+namespace X
+{
+	namespace
+	{
+		static const u32 BatchSize = 8;
+
+		// the rasterizer snaps to 1/256 pixel, a sample center this close to the bounds may still be covered
+		static const f32 SnapMargin = 1.f / 256;
+
+		enum class Verdict
+		{
+			Outside,
+			ZeroArea,
+			BackFacing,
+			SubPixel,
+			Inside,
+			Clipping,
+		};
+
+		/*
+		*	Front faces have a negative determinant when all w are positive, the same winding as IsFrontFace.
+		*/
+		f32 Determinant(f32V4 const& p0, f32V4 const& p1, f32V4 const& p2)
+		{
+			return p0.X() * (p1.Y() * p2.W() - p2.Y() * p1.W()) - p0.Y() * (p1.X() * p2.W() - p2.X() * p1.W()) + p0.W() * (p1.X() * p2.Y() - p2.X() * p1.Y());
+		}
+
+		bool OutsideGuardBand(f32V4 const& p, f32 guardBand)
+		{
+			// the same comparisons as the clip code of the rasterizer
+			f32 guardBandW = guardBand * p.W();
+			return p.X() < -guardBandW || p.X() > guardBandW || p.Y() < -guardBandW || p.Y() > guardBandW;
+		}
+
+		/*
+		*	@repeatedIndex: two of the indices are the same, the determinant is not exactly 0 after rounding.
+		*/
+		Verdict CullTriangle(f32V4 const& p0, f32V4 const& p1, f32V4 const& p2, bool repeatedIndex, f32 guardBand, f32 width, f32 height)
+		{
+			if ((p0.X() < -p0.W() && p1.X() < -p1.W() && p2.X() < -p2.W())
+				|| (p0.X() > p0.W() && p1.X() > p1.W() && p2.X() > p2.W())
+				|| (p0.Y() < -p0.W() && p1.Y() < -p1.W() && p2.Y() < -p2.W())
+				|| (p0.Y() > p0.W() && p1.Y() > p1.W() && p2.Y() > p2.W())
+				|| (p0.Z() < 0 && p1.Z() < 0 && p2.Z() < 0)
+				|| (p0.Z() > p0.W() && p1.Z() > p1.W() && p2.Z() > p2.W()))
+			{
+				return Verdict::Outside;
+			}
+			if (repeatedIndex)
+			{
+				return Verdict::ZeroArea;
+			}
+			if (p0.Z() < 0 || p1.Z() < 0 || p2.Z() < 0)
+			{
+				// w may be negative, facing is only known after clipping
+				return Verdict::Clipping;
+			}
+			f32 determinant = Determinant(p0, p1, p2);
+			if (determinant == 0)
+			{
+				return Verdict::ZeroArea;
+			}
+			if (!(determinant < 0))
+			{
+				// or not a number
+				return Verdict::BackFacing;
+			}
+			if (OutsideGuardBand(p0, guardBand) || OutsideGuardBand(p1, guardBand) || OutsideGuardBand(p2, guardBand))
+			{
+				return Verdict::Clipping;
+			}
+
+			f32 x0 = (p0.X() / p0.W() * 0.5f + 0.5f) * width;
+			f32 y0 = (p0.Y() / p0.W() * 0.5f + 0.5f) * height;
+			f32 x1 = (p1.X() / p1.W() * 0.5f + 0.5f) * width;
+			f32 y1 = (p1.Y() / p1.W() * 0.5f + 0.5f) * height;
+			f32 x2 = (p2.X() / p2.W() * 0.5f + 0.5f) * width;
+			f32 y2 = (p2.Y() / p2.W() * 0.5f + 0.5f) * height;
+			// sample centers are at half integers
+			f32 xMin = std::min(std::min(x0, x1), x2) - 0.5f - SnapMargin;
+			f32 xMax = std::max(std::max(x0, x1), x2) - 0.5f + SnapMargin;
+			f32 yMin = std::min(std::min(y0, y1), y2) - 0.5f - SnapMargin;
+			f32 yMax = std::max(std::max(y0, y1), y2) - 0.5f + SnapMargin;
+			if (std::floor(xMax) < std::ceil(xMin) || std::floor(yMax) < std::ceil(yMin))
+			{
+				return Verdict::SubPixel;
+			}
+			return Verdict::Inside;
+		}
+
+		void Count(Verdict verdict, TriangleStatistics* statistics)
+		{
+			switch (verdict)
+			{
+			case Verdict::Outside:
+				statistics->outsideCount += 1;
+				break;
+			case Verdict::ZeroArea:
+				statistics->zeroAreaCount += 1;
+				break;
+			case Verdict::BackFacing:
+				statistics->backFacingCount += 1;
+				break;
+			case Verdict::SubPixel:
+				statistics->subPixelCount += 1;
+				break;
+			default:
+				statistics->acceptedCount += 1;
+				break;
+			}
+		}
+
+		u32 BitCount(u32 mask)
+		{
+			u32 count = 0;
+			for (; mask != 0; mask &= mask - 1)
+			{
+				count += 1;
+			}
+			return count;
+		}
+
+		/*
+		*	One vertex of 8 triangles, one register per component.
+		*/
+		struct PositionLanes
+		{
+			__m256 x;
+			__m256 y;
+			__m256 z;
+			__m256 w;
+		};
+
+		PositionLanes LoadPositionLanes(f32 const* positions, u32 stride, std::array<u32, BatchSize> const& vertexIndices)
+		{
+			std::array<__m256, 4> rows;
+			for (u32 i = 0; i < 4; ++i)
+			{
+				// lane i in the low half, lane i + 4 in the high half
+				rows[i] = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(positions + vertexIndices[i] * stride)),
+					_mm_loadu_ps(positions + vertexIndices[i + 4] * stride), 1);
+			}
+			__m256 t0 = _mm256_unpacklo_ps(rows[0], rows[1]);
+			__m256 t1 = _mm256_unpackhi_ps(rows[0], rows[1]);
+			__m256 t2 = _mm256_unpacklo_ps(rows[2], rows[3]);
+			__m256 t3 = _mm256_unpackhi_ps(rows[2], rows[3]);
+			PositionLanes lanes =
+			{
+				_mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0)),
+				_mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2)),
+				_mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0)),
+				_mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2)),
+			};
+			return lanes;
+		}
+
+		__m256 OutsideGuardBandLanes(PositionLanes const& p, __m256 guardBand)
+		{
+			__m256 guardBandW = _mm256_mul_ps(guardBand, p.w);
+			__m256 negativeGuardBandW = _mm256_sub_ps(_mm256_setzero_ps(), guardBandW);
+			return _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(p.x, negativeGuardBandW, _CMP_LT_OQ), _mm256_cmp_ps(p.x, guardBandW, _CMP_GT_OQ)),
+				_mm256_or_ps(_mm256_cmp_ps(p.y, negativeGuardBandW, _CMP_LT_OQ), _mm256_cmp_ps(p.y, guardBandW, _CMP_GT_OQ)));
+		}
+
+		__m256 ScreenLanes(__m256 v, __m256 w, __m256 size)
+		{
+			__m256 half = _mm256_set1_ps(0.5f);
+			return _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_div_ps(v, w), half), half), size);
+		}
+
+		/*
+		*	@return: bit masks of the verdicts of the 8 triangles, indexed by Verdict.
+		*/
+		std::array<u32, 6> CullTrianglesAVX(PositionLanes const& p0, PositionLanes const& p1, PositionLanes const& p2, u32 repeatedIndexMask, f32 guardBand, f32 width, f32 height)
+		{
+			__m256 zero = _mm256_setzero_ps();
+			auto less = [] (__m256 a, __m256 b)
+			{
+				return _mm256_cmp_ps(a, b, _CMP_LT_OQ);
+			};
+			auto greater = [] (__m256 a, __m256 b)
+			{
+				return _mm256_cmp_ps(a, b, _CMP_GT_OQ);
+			};
+			auto all = [] (__m256 a, __m256 b, __m256 c)
+			{
+				return _mm256_and_ps(_mm256_and_ps(a, b), c);
+			};
+			auto any = [] (__m256 a, __m256 b, __m256 c)
+			{
+				return _mm256_or_ps(_mm256_or_ps(a, b), c);
+			};
+			__m256 negativeW0 = _mm256_sub_ps(zero, p0.w);
+			__m256 negativeW1 = _mm256_sub_ps(zero, p1.w);
+			__m256 negativeW2 = _mm256_sub_ps(zero, p2.w);
+
+			__m256 outside = any(
+				any(all(less(p0.x, negativeW0), less(p1.x, negativeW1), less(p2.x, negativeW2)),
+					all(greater(p0.x, p0.w), greater(p1.x, p1.w), greater(p2.x, p2.w)),
+					all(less(p0.y, negativeW0), less(p1.y, negativeW1), less(p2.y, negativeW2))),
+				all(greater(p0.y, p0.w), greater(p1.y, p1.w), greater(p2.y, p2.w)),
+				_mm256_or_ps(all(less(p0.z, zero), less(p1.z, zero), less(p2.z, zero)),
+					all(greater(p0.z, p0.w), greater(p1.z, p1.w), greater(p2.z, p2.w))));
+			__m256 near = any(less(p0.z, zero), less(p1.z, zero), less(p2.z, zero));
+
+			// the same operation order as Determinant
+			__m256 determinant = _mm256_add_ps(_mm256_sub_ps(
+				_mm256_mul_ps(p0.x, _mm256_sub_ps(_mm256_mul_ps(p1.y, p2.w), _mm256_mul_ps(p2.y, p1.w))),
+				_mm256_mul_ps(p0.y, _mm256_sub_ps(_mm256_mul_ps(p1.x, p2.w), _mm256_mul_ps(p2.x, p1.w)))),
+				_mm256_mul_ps(p0.w, _mm256_sub_ps(_mm256_mul_ps(p1.x, p2.y), _mm256_mul_ps(p2.x, p1.y))));
+			__m256 zeroArea = _mm256_cmp_ps(determinant, zero, _CMP_EQ_OQ);
+			__m256 front = less(determinant, zero);
+
+			__m256 guardBandLanes = _mm256_set1_ps(guardBand);
+			__m256 outsideGuardBand = any(OutsideGuardBandLanes(p0, guardBandLanes), OutsideGuardBandLanes(p1, guardBandLanes), OutsideGuardBandLanes(p2, guardBandLanes));
+
+			__m256 widthLanes = _mm256_set1_ps(width);
+			__m256 heightLanes = _mm256_set1_ps(height);
+			__m256 x0 = ScreenLanes(p0.x, p0.w, widthLanes);
+			__m256 y0 = ScreenLanes(p0.y, p0.w, heightLanes);
+			__m256 x1 = ScreenLanes(p1.x, p1.w, widthLanes);
+			__m256 y1 = ScreenLanes(p1.y, p1.w, heightLanes);
+			__m256 x2 = ScreenLanes(p2.x, p2.w, widthLanes);
+			__m256 y2 = ScreenLanes(p2.y, p2.w, heightLanes);
+			__m256 lowMargin = _mm256_set1_ps(0.5f + SnapMargin);
+			__m256 highMargin = _mm256_set1_ps(0.5f - SnapMargin);
+			__m256 xMin = _mm256_sub_ps(_mm256_min_ps(_mm256_min_ps(x0, x1), x2), lowMargin);
+			__m256 xMax = _mm256_sub_ps(_mm256_max_ps(_mm256_max_ps(x0, x1), x2), highMargin);
+			__m256 yMin = _mm256_sub_ps(_mm256_min_ps(_mm256_min_ps(y0, y1), y2), lowMargin);
+			__m256 yMax = _mm256_sub_ps(_mm256_max_ps(_mm256_max_ps(y0, y1), y2), highMargin);
+			__m256 noSample = _mm256_or_ps(less(_mm256_floor_ps(xMax), _mm256_ceil_ps(xMin)), less(_mm256_floor_ps(yMax), _mm256_ceil_ps(yMin)));
+
+			u32 outsideMask = _mm256_movemask_ps(outside);
+			u32 repeatedMask = repeatedIndexMask & ~outsideMask;
+			u32 nearMask = _mm256_movemask_ps(near) & ~(outsideMask | repeatedMask);
+			u32 rest = ~(outsideMask | repeatedMask | nearMask) & 0xFF;
+			u32 zeroAreaMask = repeatedMask | (_mm256_movemask_ps(zeroArea) & rest);
+			u32 frontMask = _mm256_movemask_ps(front) & rest;
+			u32 backFacingMask = rest & ~zeroAreaMask & ~frontMask;
+			u32 guardBandMask = frontMask & _mm256_movemask_ps(outsideGuardBand);
+			u32 subPixelMask = frontMask & ~guardBandMask & _mm256_movemask_ps(noSample);
+			u32 insideMask = frontMask & ~guardBandMask & ~subPixelMask;
+
+			std::array<u32, 6> masks;
+			masks[static_cast<u32>(Verdict::Outside)] = outsideMask;
+			masks[static_cast<u32>(Verdict::ZeroArea)] = zeroAreaMask;
+			masks[static_cast<u32>(Verdict::BackFacing)] = backFacingMask;
+			masks[static_cast<u32>(Verdict::SubPixel)] = subPixelMask;
+			masks[static_cast<u32>(Verdict::Inside)] = insideMask;
+			masks[static_cast<u32>(Verdict::Clipping)] = nearMask | guardBandMask;
+			return masks;
+		}
+	}
+
+	TriangleCuller::TriangleCuller(Size<u32, 2> const& resolution)
+		: resolution_(resolution)
+	{
+	}
+
+	void TriangleCuller::Cull(std::vector<AttributeOutputPackage> const& vertices, IndexData const& indices, u32 instanceCount, u32 vertexCount, f32 guardBand, VisibleTriangles* result) const
+	{
+		static_assert(sizeof(AttributeOutputPackage) % sizeof(f32) == 0, "position is loaded with a stride in floats.");
+		f32 const* positions = vertices.empty() ? nullptr : reinterpret_cast<f32 const*>(&vertices[0].position);
+		indices.Visit([&] (auto const& typedIndices)
+		{
+			DoCull(positions, sizeof(AttributeOutputPackage) / sizeof(f32), typedIndices, instanceCount, vertexCount, guardBand, result);
+		});
+	}
+
+	void TriangleCuller::Cull(std::vector<f32V4> const& positions, IndexData const& indices, u32 instanceCount, u32 vertexCount, f32 guardBand, VisibleTriangles* result) const
+	{
+		f32 const* floats = positions.empty() ? nullptr : reinterpret_cast<f32 const*>(&positions[0]);
+		indices.Visit([&] (auto const& typedIndices)
+		{
+			DoCull(floats, sizeof(f32V4) / sizeof(f32), typedIndices, instanceCount, vertexCount, guardBand, result);
+		});
+	}
+
+	template <typename IndexT>
+	void TriangleCuller::DoCull(f32 const* allPositions, u32 stride, std::vector<IndexT> const& indices, u32 instanceCount, u32 vertexCount, f32 guardBand, VisibleTriangles* result) const
+	{
+		assert(indices.size() % 3 == 0);
+		u32 triangleCount = indices.size() / 3;
+		f32 width = f32(resolution_.X());
+		f32 height = f32(resolution_.Y());
+
+		result->triangles.clear();
+		result->clipping.clear();
+		result->statistics = TriangleStatistics();
+		TriangleStatistics& statistics = result->statistics;
+
+		for (u32 instance = 0; instance < instanceCount; ++instance)
+		{
+			f32 const* positions = allPositions + instance * vertexCount * stride;
+			u32 firstTriangle = instance * triangleCount;
+
+			if (!GetCPUFeature().avx)
+			{
+				for (u32 i = 0; i < triangleCount; ++i)
+				{
+					u32 i0 = indices[i * 3 + 0];
+					u32 i1 = indices[i * 3 + 1];
+					u32 i2 = indices[i * 3 + 2];
+					f32V4 const& p0 = *reinterpret_cast<f32V4 const*>(positions + i0 * stride);
+					f32V4 const& p1 = *reinterpret_cast<f32V4 const*>(positions + i1 * stride);
+					f32V4 const& p2 = *reinterpret_cast<f32V4 const*>(positions + i2 * stride);
+					Verdict verdict = CullTriangle(p0, p1, p2, i0 == i1 || i1 == i2 || i2 == i0, guardBand, width, height);
+					Count(verdict, &statistics);
+					if (verdict == Verdict::Inside || verdict == Verdict::Clipping)
+					{
+						result->triangles.push_back(firstTriangle + i);
+						result->clipping.push_back(verdict == Verdict::Clipping ? 1 : 0);
+					}
+				}
+				continue;
+			}
+
+			for (u32 i = 0; i < triangleCount; i += BatchSize)
+			{
+				// lanes past the end repeat the first triangle and are masked off
+				u32 laneCount = std::min(triangleCount - i, BatchSize);
+				u32 validMask = (1u << laneCount) - 1;
+				std::array<std::array<u32, BatchSize>, 3> vertexIndices;
+				u32 repeatedIndexMask = 0;
+				for (u32 lane = 0; lane < BatchSize; ++lane)
+				{
+					u32 triangle = lane < laneCount ? i + lane : i;
+					for (u32 j = 0; j < 3; ++j)
+					{
+						vertexIndices[j][lane] = indices[triangle * 3 + j];
+					}
+					if (vertexIndices[0][lane] == vertexIndices[1][lane] || vertexIndices[1][lane] == vertexIndices[2][lane] || vertexIndices[2][lane] == vertexIndices[0][lane])
+					{
+						repeatedIndexMask |= 1u << lane;
+					}
+				}
+				std::array<u32, 6> masks = CullTrianglesAVX(LoadPositionLanes(positions, stride, vertexIndices[0]),
+					LoadPositionLanes(positions, stride, vertexIndices[1]), LoadPositionLanes(positions, stride, vertexIndices[2]), repeatedIndexMask, guardBand, width, height);
+				for (u32& mask : masks)
+				{
+					mask &= validMask;
+				}
+
+				statistics.outsideCount += BitCount(masks[static_cast<u32>(Verdict::Outside)]);
+				statistics.zeroAreaCount += BitCount(masks[static_cast<u32>(Verdict::ZeroArea)]);
+				statistics.backFacingCount += BitCount(masks[static_cast<u32>(Verdict::BackFacing)]);
+				statistics.subPixelCount += BitCount(masks[static_cast<u32>(Verdict::SubPixel)]);
+				u32 acceptedMask = masks[static_cast<u32>(Verdict::Inside)] | masks[static_cast<u32>(Verdict::Clipping)];
+				statistics.acceptedCount += BitCount(acceptedMask);
+
+				// compact the survivors
+				for (u32 lane = 0; lane < laneCount; ++lane)
+				{
+					if ((acceptedMask & (1u << lane)) != 0)
+					{
+						result->triangles.push_back(firstTriangle + i + lane);
+						result->clipping.push_back((masks[static_cast<u32>(Verdict::Clipping)] >> lane) & 1);
+					}
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "Common.hpp"
+#include "PipelineDetail.hpp"
+#include "Pipeline.hpp"
+#include "Buffer.hpp"
+
+namespace X
+{
+	/*
+	*	Triangles of one draw surviving culling, in submission order.
+	*/
+	struct VisibleTriangles
+	{
+		std::vector<u32> triangles; // triangle index in the index buffer, of instances after the first offset by the triangle count
+		std::vector<u8> clipping; // per visible triangle, nonzero if it crosses the near plane or the guard band
+		TriangleStatistics statistics;
+	};
+
+	/*
+	*	Per triangle culling after the vertex transform, 8 triangles at a time with AVX when supported.
+	*	Rejects triangles outside the frustum, of zero area, back facing and covering no sample center,
+	*	the rasterizer takes the survivors without testing them again.
+	*/
+	class TriangleCuller
+		: Noncopyable
+	{
+	public:
+		explicit TriangleCuller(Size<u32, 2> const& resolution);
+
+		/*
+		*	@vertices: clip space post-transform vertices.
+		*	@instanceCount: copies of the triangle list, triangle i of instance n is n * triangleCount + i in the result.
+		*	@vertexCount: of one instance, vertices of instance n start at n * vertexCount.
+		*	@guardBand: of the fill rasterizer, decides which triangles are clipped.
+		*	@result: storage reused between frames.
+		*/
+		void Cull(std::vector<AttributeOutputPackage> const& vertices, IndexData const& indices, u32 instanceCount, u32 vertexCount, f32 guardBand, VisibleTriangles* result) const;
+		/*
+		*	@positions: clip space positions, of a position only transform.
+		*/
+		void Cull(std::vector<f32V4> const& positions, IndexData const& indices, u32 instanceCount, u32 vertexCount, f32 guardBand, VisibleTriangles* result) const;
+
+	private:
+		template <typename IndexT>
+		void DoCull(f32 const* positions, u32 stride, std::vector<IndexT> const& indices, u32 instanceCount, u32 vertexCount, f32 guardBand, VisibleTriangles* result) const;
+
+	private:
+		Size<u32, 2> resolution_;
+	};
+}
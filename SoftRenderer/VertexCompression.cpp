@@ -0,0 +1,140 @@
+#include "Header.hpp"
+#include "VertexCompression.hpp"
+
+namespace X
+{
+	namespace
+	{
+		static const f32 PositionSteps = 65535.f;
+		static const f32 NormalSteps = 32767.f;
+
+		u16 QuantizePosition(f32 value, f32 offset, f32 scale)
+		{
+			if (scale <= 0)
+			{
+				return 0;
+			}
+			return static_cast<u16>(std::min(std::max(std::round((value - offset) / scale), 0.f), PositionSteps));
+		}
+
+		s16 QuantizeNormal(f32 value)
+		{
+			return static_cast<s16>(std::round(std::min(std::max(value, -1.f), 1.f) * NormalSteps));
+		}
+
+		f32 SignNotZero(f32 value)
+		{
+			return value >= 0 ? 1.f : -1.f;
+		}
+	}
+
+	VertexQuantization MakeVertexQuantization(BoundingBox const& bounds)
+	{
+		VertexQuantization quantization;
+		quantization.offset = bounds.GetPosition() - bounds.GetHalfExtend();
+		quantization.scale = bounds.GetHalfExtend() * 2 / PositionSteps;
+		return quantization;
+	}
+
+	CompactVertex CompressVertex(Vertex const& vertex, VertexQuantization const& quantization)
+	{
+		CompactVertex result;
+		for (u32 i = 0; i < 3; ++i)
+		{
+			result.position[i] = QuantizePosition(vertex.position[i], quantization.offset[i], quantization.scale[i]);
+		}
+		result.position[3] = 0;
+
+		// project to the octahedron, then fold the lower half over the diagonals
+		f32V3 const& normal = vertex.normal;
+		f32 sum = std::abs(normal.X()) + std::abs(normal.Y()) + std::abs(normal.Z());
+		f32 x = sum > 0 ? normal.X() / sum : 0;
+		f32 y = sum > 0 ? normal.Y() / sum : 0;
+		if (normal.Z() < 0)
+		{
+			f32 foldedX = (1 - std::abs(y)) * SignNotZero(x);
+			f32 foldedY = (1 - std::abs(x)) * SignNotZero(y);
+			x = foldedX;
+			y = foldedY;
+		}
+		result.normal[0] = QuantizeNormal(x);
+		result.normal[1] = QuantizeNormal(y);
+
+		result.textureCoordinate[0] = FloatToHalf(vertex.textureCoordinate.X());
+		result.textureCoordinate[1] = FloatToHalf(vertex.textureCoordinate.Y());
+		return result;
+	}
+
+	Vertex DecompressVertex(CompactVertex const& vertex, VertexQuantization const& quantization)
+	{
+		f32V3 position(
+			quantization.offset.X() + f32(vertex.position[0]) * quantization.scale.X(),
+			quantization.offset.Y() + f32(vertex.position[1]) * quantization.scale.Y(),
+			quantization.offset.Z() + f32(vertex.position[2]) * quantization.scale.Z());
+
+		// unfold, the lower half has |x| + |y| > 1
+		f32 x = std::max(f32(vertex.normal[0]) * (1 / NormalSteps), -1.f);
+		f32 y = std::max(f32(vertex.normal[1]) * (1 / NormalSteps), -1.f);
+		f32 z = 1 - std::abs(x) - std::abs(y);
+		f32 fold = std::max(-z, 0.f);
+		x = x - (x >= 0 ? fold : -fold);
+		y = y - (y >= 0 ? fold : -fold);
+		f32 inverseLength = 1 / std::sqrt(x * x + y * y + z * z);
+		f32V3 normal(x * inverseLength, y * inverseLength, z * inverseLength);
+
+		f32V2 textureCoordinate(HalfToFloat(vertex.textureCoordinate[0]), HalfToFloat(vertex.textureCoordinate[1]));
+		return Vertex(position, normal, textureCoordinate);
+	}
+
+	u16 FloatToHalf(f32 value)
+	{
+		u32 bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		u32 sign = (bits >> 16) & 0x8000;
+		u32 magnitude = bits & 0x7fffffff;
+		if (magnitude >= 0x7f800000)
+		{
+			// infinity, or a quiet NaN
+			return static_cast<u16>(sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0));
+		}
+		if (magnitude >= 0x477ff000)
+		{
+			// rounds to more than the largest half, 65504
+			return static_cast<u16>(sign | 0x7c00);
+		}
+		if (magnitude < 0x38800000)
+		{
+			// subnormal, in steps of 2^-24, the scaling is exact
+			return static_cast<u16>(sign | static_cast<u32>(std::nearbyint(std::abs(value) * 16777216.f)));
+		}
+		// rebias the exponent from 127 to 15, then round the 13 dropped mantissa bits to nearest even
+		u32 rebiased = magnitude - 0x38000000;
+		return static_cast<u16>(sign | ((rebiased + 0xfff + ((rebiased >> 13) & 1)) >> 13));
+	}
+
+	f32 HalfToFloat(u16 value)
+	{
+		u32 sign = static_cast<u32>(value & 0x8000) << 16;
+		u32 exponent = (value >> 10) & 0x1f;
+		u32 mantissa = value & 0x3ff;
+		u32 bits;
+		if (exponent == 0)
+		{
+			// zero or subnormal, exact in f32
+			f32 magnitude = std::ldexp(f32(mantissa), -24);
+			std::memcpy(&bits, &magnitude, sizeof(bits));
+			bits |= sign;
+		}
+		else if (exponent == 0x1f)
+		{
+			bits = sign | 0x7f800000 | (mantissa << 13);
+		}
+		else
+		{
+			bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+		}
+		f32 result;
+		std::memcpy(&result, &bits, sizeof(result));
+		return result;
+	}
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "Common.hpp"
+#include "Primitive.hpp"
+
+namespace X
+{
+	/*
+	*	Quantization spanning the box, 65535 steps per axis.
+	*/
+	VertexQuantization MakeVertexQuantization(BoundingBox const& bounds);
+
+	/*
+	*	@vertex: position has to be inside the bounds of quantization, normal is normalized by decoding.
+	*/
+	CompactVertex CompressVertex(Vertex const& vertex, VertexQuantization const& quantization);
+	/*
+	*	Same operation order as the batched decode in VertexTransform, so the results are identical.
+	*/
+	Vertex DecompressVertex(CompactVertex const& vertex, VertexQuantization const& quantization);
+
+	/*
+	*	IEEE 754 binary16, rounded to nearest even, out of range values become infinity.
+	*/
+	u16 FloatToHalf(f32 value);
+	f32 HalfToFloat(u16 value);
+}
@@ -0,0 +1,395 @@
+#include "Header.hpp"
+#include "VertexTransform.hpp"
+#include "CPUFeature.hpp"
+#include "VertexCompression.hpp"
+
+#include <immintrin.h>
+
+namespace X
+{
+	namespace
+	{
+		static const u32 BatchSize = 8;
+
+		static_assert(sizeof(Vertex) == 8 * sizeof(f32), "Vertex is loaded as one row of 8 floats.");
+		static_assert(sizeof(CompactVertex) == 16, "CompactVertex is loaded as one 16 byte vector.");
+		static_assert(sizeof(AttributeOutputPackage) == 12 * sizeof(f32), "AttributeOutputPackage is stored as 8 floats of vertex and 4 floats of position.");
+
+		void TransformVertex(Vertex const& vertex, f32M44 const& modelToViewMatrix, f32M44 const& modelToClipMatrix, AttributeOutputPackage* output)
+		{
+			f32V3 positionInView = Transform(vertex.position, modelToViewMatrix);
+			f32V4 position = Transform(f32V4(vertex.position.X(), vertex.position.Y(), vertex.position.Z(), 1), modelToClipMatrix);
+			f32V3 normalInView = TransformDirection(vertex.normal, modelToViewMatrix);
+			*output = AttributeOutputPackage(Vertex(positionInView, normalInView, vertex.textureCoordinate), position);
+		}
+
+		void TransformPosition(Vertex const& vertex, f32M44 const& modelToClipMatrix, f32V4* output)
+		{
+			*output = Transform(f32V4(vertex.position.X(), vertex.position.Y(), vertex.position.Z(), 1), modelToClipMatrix);
+		}
+
+		/*
+		*	Every element of a matrix broadcast to all lanes.
+		*/
+		struct MatrixLanes
+		{
+			std::array<__m256, 16> m;
+			MatrixLanes(f32M44 const& matrix)
+			{
+				for (u32 i = 0; i < 16; ++i)
+				{
+					m[i] = _mm256_set1_ps(matrix[i]);
+				}
+			}
+		};
+
+		/*
+		*	8 vertices in structure of arrays form, one register per component.
+		*/
+		struct VertexLanes
+		{
+			__m256 x;
+			__m256 y;
+			__m256 z;
+			__m256 normalX;
+			__m256 normalY;
+			__m256 normalZ;
+			__m256 u;
+			__m256 v;
+		};
+
+		/*
+		*	Rows become columns, the same shuffle converts AoS to SoA and back.
+		*/
+		void Transpose8x8(std::array<__m256, 8>& rows)
+		{
+			__m256 t0 = _mm256_unpacklo_ps(rows[0], rows[1]);
+			__m256 t1 = _mm256_unpackhi_ps(rows[0], rows[1]);
+			__m256 t2 = _mm256_unpacklo_ps(rows[2], rows[3]);
+			__m256 t3 = _mm256_unpackhi_ps(rows[2], rows[3]);
+			__m256 t4 = _mm256_unpacklo_ps(rows[4], rows[5]);
+			__m256 t5 = _mm256_unpackhi_ps(rows[4], rows[5]);
+			__m256 t6 = _mm256_unpacklo_ps(rows[6], rows[7]);
+			__m256 t7 = _mm256_unpackhi_ps(rows[6], rows[7]);
+			__m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+			__m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+			__m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+			__m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+			__m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+			__m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+			__m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+			__m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+			rows[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+			rows[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+			rows[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+			rows[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+			rows[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+			rows[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+			rows[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+			rows[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+		}
+
+		VertexLanes LoadVertexLanes(Vertex const* vertices)
+		{
+			f32 const* floats = reinterpret_cast<f32 const*>(vertices);
+			std::array<__m256, 8> rows;
+			for (u32 i = 0; i < BatchSize; ++i)
+			{
+				rows[i] = _mm256_loadu_ps(floats + i * 8);
+			}
+			Transpose8x8(rows);
+			VertexLanes lanes = { rows[0], rows[1], rows[2], rows[3], rows[4], rows[5], rows[6], rows[7] };
+			return lanes;
+		}
+
+		/*
+		*	Decoded while loading, same operation order as DecompressVertex, so the results are identical.
+		*	Needs SSE4.1 and F16C besides AVX.
+		*/
+		VertexLanes LoadCompactVertexLanes(CompactVertex const* vertices, VertexQuantization const& quantization)
+		{
+			// widened to rows of 8 floats: quantized x, y, z, w, octahedral x, y, texture coordinate u, v
+			std::array<__m256, 8> rows;
+			for (u32 i = 0; i < BatchSize; ++i)
+			{
+				__m128i packed = _mm_loadu_si128(reinterpret_cast<__m128i const*>(vertices + i));
+				__m128 position = _mm_cvtepi32_ps(_mm_cvtepu16_epi32(packed));
+				__m128 normal = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_srli_si128(packed, 8)));
+				__m128 textureCoordinate = _mm_cvtph_ps(_mm_srli_si128(packed, 12));
+				__m128 high = _mm_shuffle_ps(normal, textureCoordinate, _MM_SHUFFLE(1, 0, 1, 0));
+				rows[i] = _mm256_insertf128_ps(_mm256_castps128_ps256(position), high, 1);
+			}
+			Transpose8x8(rows);
+
+			__m256 zero = _mm256_setzero_ps();
+			__m256 one = _mm256_set1_ps(1.f);
+			__m256 signMask = _mm256_set1_ps(-0.f);
+			__m256 normalScale = _mm256_set1_ps(1 / 32767.f);
+			__m256 x = _mm256_max_ps(_mm256_mul_ps(rows[4], normalScale), _mm256_set1_ps(-1.f));
+			__m256 y = _mm256_max_ps(_mm256_mul_ps(rows[5], normalScale), _mm256_set1_ps(-1.f));
+			__m256 z = _mm256_sub_ps(_mm256_sub_ps(one, _mm256_andnot_ps(signMask, x)), _mm256_andnot_ps(signMask, y));
+			// fold is positive, takes the sign of x and y to move them towards 0
+			__m256 fold = _mm256_max_ps(_mm256_xor_ps(z, signMask), zero);
+			x = _mm256_sub_ps(x, _mm256_or_ps(fold, _mm256_and_ps(x, signMask)));
+			y = _mm256_sub_ps(y, _mm256_or_ps(fold, _mm256_and_ps(y, signMask)));
+			__m256 inverseLength = _mm256_div_ps(one, _mm256_sqrt_ps(
+				_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z))));
+
+			VertexLanes lanes =
+			{
+				_mm256_add_ps(_mm256_set1_ps(quantization.offset.X()), _mm256_mul_ps(rows[0], _mm256_set1_ps(quantization.scale.X()))),
+				_mm256_add_ps(_mm256_set1_ps(quantization.offset.Y()), _mm256_mul_ps(rows[1], _mm256_set1_ps(quantization.scale.Y()))),
+				_mm256_add_ps(_mm256_set1_ps(quantization.offset.Z()), _mm256_mul_ps(rows[2], _mm256_set1_ps(quantization.scale.Z()))),
+				_mm256_mul_ps(x, inverseLength),
+				_mm256_mul_ps(y, inverseLength),
+				_mm256_mul_ps(z, inverseLength),
+				rows[6],
+				rows[7],
+			};
+			return lanes;
+		}
+
+		/*
+		*	Vertex fetch of an uncompressed buffer.
+		*/
+		struct VertexSource
+		{
+			Vertex const* vertices;
+
+			explicit VertexSource(VertexBuffer const& buffer)
+				: vertices(buffer.GetData().data())
+			{
+			}
+			static bool CanLoadLanes()
+			{
+				return GetCPUFeature().avx;
+			}
+			Vertex const& Fetch(u32 index) const
+			{
+				return vertices[index];
+			}
+			VertexLanes LoadLanes(u32 index) const
+			{
+				return LoadVertexLanes(vertices + index);
+			}
+		};
+
+		/*
+		*	Vertex fetch of a compressed buffer, decoded on load.
+		*/
+		struct CompactVertexSource
+		{
+			CompactVertex const* vertices;
+			VertexQuantization quantization;
+
+			explicit CompactVertexSource(VertexBuffer const& buffer)
+				: vertices(buffer.GetCompressedData().data()), quantization(buffer.GetQuantization())
+			{
+			}
+			static bool CanLoadLanes()
+			{
+				CPUFeature const& feature = GetCPUFeature();
+				return feature.avx && feature.sse41 && feature.f16c;
+			}
+			Vertex Fetch(u32 index) const
+			{
+				return DecompressVertex(vertices[index], quantization);
+			}
+			VertexLanes LoadLanes(u32 index) const
+			{
+				return LoadCompactVertexLanes(vertices + index, quantization);
+			}
+		};
+
+		/*
+		*	Same operation order as the scalar Transform, so the results are identical.
+		*/
+		__m256 Row(MatrixLanes const& matrix, u32 column, __m256 x, __m256 y, __m256 z)
+		{
+			return _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+				_mm256_mul_ps(matrix.m[column], x), _mm256_mul_ps(matrix.m[column + 4], y)), _mm256_mul_ps(matrix.m[column + 8], z)), matrix.m[column + 12]);
+		}
+
+		__m256 RowDirection(MatrixLanes const& matrix, u32 column, __m256 x, __m256 y, __m256 z)
+		{
+			return _mm256_add_ps(_mm256_add_ps(
+				_mm256_mul_ps(matrix.m[column], x), _mm256_mul_ps(matrix.m[column + 4], y)), _mm256_mul_ps(matrix.m[column + 8], z));
+		}
+
+		/*
+		*	4 component lanes to 4 vectors in place, vector i holds vertex i in the low half and vertex i + 4 in the high half.
+		*/
+		void Transpose4x8(std::array<__m256, 4>& rows)
+		{
+			__m256 t0 = _mm256_unpacklo_ps(rows[0], rows[1]);
+			__m256 t1 = _mm256_unpackhi_ps(rows[0], rows[1]);
+			__m256 t2 = _mm256_unpacklo_ps(rows[2], rows[3]);
+			__m256 t3 = _mm256_unpackhi_ps(rows[2], rows[3]);
+			rows[0] = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+			rows[1] = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+			rows[2] = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+			rows[3] = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+		}
+
+		void TransformVerticesAVX(VertexLanes const& in, MatrixLanes const& modelToView, MatrixLanes const& modelToClip, AttributeOutputPackage* output)
+		{
+			__m256 inverseW = _mm256_div_ps(_mm256_set1_ps(1.f), Row(modelToView, 3, in.x, in.y, in.z));
+			std::array<__m256, 8> rows =
+			{
+				_mm256_mul_ps(Row(modelToView, 0, in.x, in.y, in.z), inverseW),
+				_mm256_mul_ps(Row(modelToView, 1, in.x, in.y, in.z), inverseW),
+				_mm256_mul_ps(Row(modelToView, 2, in.x, in.y, in.z), inverseW),
+				RowDirection(modelToView, 0, in.normalX, in.normalY, in.normalZ),
+				RowDirection(modelToView, 1, in.normalX, in.normalY, in.normalZ),
+				RowDirection(modelToView, 2, in.normalX, in.normalY, in.normalZ),
+				in.u,
+				in.v,
+			};
+			Transpose8x8(rows);
+			for (u32 i = 0; i < BatchSize; ++i)
+			{
+				_mm256_storeu_ps(reinterpret_cast<f32*>(&output[i].vertex), rows[i]);
+			}
+
+			std::array<__m256, 4> positions =
+			{
+				Row(modelToClip, 0, in.x, in.y, in.z),
+				Row(modelToClip, 1, in.x, in.y, in.z),
+				Row(modelToClip, 2, in.x, in.y, in.z),
+				Row(modelToClip, 3, in.x, in.y, in.z),
+			};
+			Transpose4x8(positions);
+			for (u32 i = 0; i < 4; ++i)
+			{
+				_mm_storeu_ps(reinterpret_cast<f32*>(&output[i].position), _mm256_castps256_ps128(positions[i]));
+				_mm_storeu_ps(reinterpret_cast<f32*>(&output[i + 4].position), _mm256_extractf128_ps(positions[i], 1));
+			}
+		}
+
+		void TransformPositionsAVX(VertexLanes const& in, MatrixLanes const& modelToClip, f32V4* output)
+		{
+			std::array<__m256, 4> positions =
+			{
+				Row(modelToClip, 0, in.x, in.y, in.z),
+				Row(modelToClip, 1, in.x, in.y, in.z),
+				Row(modelToClip, 2, in.x, in.y, in.z),
+				Row(modelToClip, 3, in.x, in.y, in.z),
+			};
+			Transpose4x8(positions);
+			// output is contiguous, store 2 positions at once
+			f32* floats = reinterpret_cast<f32*>(output);
+			_mm256_storeu_ps(floats + 0, _mm256_permute2f128_ps(positions[0], positions[1], 0x20));
+			_mm256_storeu_ps(floats + 8, _mm256_permute2f128_ps(positions[2], positions[3], 0x20));
+			_mm256_storeu_ps(floats + 16, _mm256_permute2f128_ps(positions[0], positions[1], 0x31));
+			_mm256_storeu_ps(floats + 24, _mm256_permute2f128_ps(positions[2], positions[3], 0x31));
+		}
+
+		template <typename SourceT>
+		void DoTransformVertices(SourceT const& source, u32 count, f32M44 const& modelToViewMatrix, f32M44 const& modelToClipMatrix, AttributeOutputPackage* output)
+		{
+			u32 i = 0;
+			if (SourceT::CanLoadLanes())
+			{
+				MatrixLanes modelToView(modelToViewMatrix);
+				MatrixLanes modelToClip(modelToClipMatrix);
+				for (; i + BatchSize <= count; i += BatchSize)
+				{
+					TransformVerticesAVX(source.LoadLanes(i), modelToView, modelToClip, &output[i]);
+				}
+			}
+			// remainder, or all without AVX
+			for (; i < count; ++i)
+			{
+				TransformVertex(source.Fetch(i), modelToViewMatrix, modelToClipMatrix, &output[i]);
+			}
+		}
+
+		template <typename SourceT>
+		void DoTransformPositions(SourceT const& source, u32 count, f32M44 const& modelToClipMatrix, f32V4* output)
+		{
+			u32 i = 0;
+			if (SourceT::CanLoadLanes())
+			{
+				MatrixLanes modelToClip(modelToClipMatrix);
+				for (; i + BatchSize <= count; i += BatchSize)
+				{
+					TransformPositionsAVX(source.LoadLanes(i), modelToClip, &output[i]);
+				}
+			}
+			for (; i < count; ++i)
+			{
+				TransformPosition(source.Fetch(i), modelToClipMatrix, &output[i]);
+			}
+		}
+
+		template <typename SourceT>
+		void DoTransformVisibleVertices(SourceT const& source, IndexData const& indices, std::vector<u32> const& triangles,
+			f32M44 const& modelToViewMatrix, f32M44 const& modelToClipMatrix, AttributeOutputPackage* output, std::vector<u8>* marks, VertexStatistics* statistics)
+		{
+			indices.Visit([&] (auto const& typedIndices)
+			{
+				PostTransformCache cache;
+				for (u32 triangle : triangles)
+				{
+					for (u32 j = 0; j < 3; ++j)
+					{
+						u32 index = typedIndices[triangle * 3 + j];
+						if (cache.Fetch(index))
+						{
+							continue;
+						}
+						TransformVertex(source.Fetch(index), modelToViewMatrix, modelToClipMatrix, &output[index]);
+						statistics->shadedVertexCount += 1;
+						if ((*marks)[index] == 0)
+						{
+							(*marks)[index] = 1;
+							statistics->uniqueVertexCount += 1;
+						}
+					}
+				}
+			});
+		}
+	}
+
+	void TransformVertices(VertexBuffer const& vertices, f32M44 const& modelToViewMatrix, f32M44 const& modelToClipMatrix, AttributeOutputPackage* output)
+	{
+		if (vertices.IsCompressed())
+		{
+			DoTransformVertices(CompactVertexSource(vertices), vertices.GetCount(), modelToViewMatrix, modelToClipMatrix, output);
+		}
+		else
+		{
+			DoTransformVertices(VertexSource(vertices), vertices.GetCount(), modelToViewMatrix, modelToClipMatrix, output);
+		}
+	}
+
+	void TransformPositions(VertexBuffer const& vertices, f32M44 const& modelToClipMatrix, f32V4* output)
+	{
+		if (vertices.IsCompressed())
+		{
+			DoTransformPositions(CompactVertexSource(vertices), vertices.GetCount(), modelToClipMatrix, output);
+		}
+		else
+		{
+			DoTransformPositions(VertexSource(vertices), vertices.GetCount(), modelToClipMatrix, output);
+		}
+	}
+
+	void TransformVisibleVertices(VertexBuffer const& vertices, IndexData const& indices, std::vector<u32> const& triangles,
+		f32M44 const& modelToViewMatrix, f32M44 const& modelToClipMatrix, AttributeOutputPackage* output, std::vector<u8>* marks, VertexStatistics* statistics)
+	{
+		marks->assign(vertices.GetCount(), 0);
+		statistics->vertexCount = vertices.GetCount();
+		statistics->uniqueVertexCount = 0;
+		statistics->shadedVertexCount = 0;
+
+		if (vertices.IsCompressed())
+		{
+			DoTransformVisibleVertices(CompactVertexSource(vertices), indices, triangles, modelToViewMatrix, modelToClipMatrix, output, marks, statistics);
+		}
+		else
+		{
+			DoTransformVisibleVertices(VertexSource(vertices), indices, triangles, modelToViewMatrix, modelToClipMatrix, output, marks, statistics);
+		}
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "Common.hpp"
+#include "PipelineDetail.hpp"
+#include "Pipeline.hpp"
+#include "Buffer.hpp"
+
+namespace X
+{
+	/*
+	*	FIFO of the last shaded vertex indices.
+	*/
+	class PostTransformCache
+	{
+	public:
+		static const u32 Size = 32;
+
+	public:
+		PostTransformCache()
+			: next_(0)
+		{
+			// never equal to an index, vertex count is less than it
+			entries_.fill(~0u);
+		}
+
+		/*
+		*	@return: true on hit, otherwise the index replaces the oldest entry.
+		*/
+		bool Fetch(u32 index)
+		{
+			for (u32 i = 0; i < Size; ++i)
+			{
+				if (entries_[i] == index)
+				{
+					return true;
+				}
+			}
+			entries_[next_] = index;
+			next_ = (next_ + 1) % Size;
+			return false;
+		}
+
+	private:
+		std::array<u32, Size> entries_;
+		u32 next_;
+	};
+
+	/*
+	*	Batched transform of a vertex buffer, 8 vertices per iteration with AVX when supported.
+	*	Results are the same as calling Transform and TransformDirection on each vertex.
+	*	Compressed buffers are decoded in the same fetch.
+	*/
+
+	/*
+	*	Position to view and clip space, normal to view space, texture coordinate copied.
+	*	@output: at least vertices.GetCount() elements.
+	*/
+	void TransformVertices(VertexBuffer const& vertices, f32M44 const& modelToViewMatrix, f32M44 const& modelToClipMatrix, AttributeOutputPackage* output);
+	/*
+	*	Position to clip space only.
+	*	@output: at least vertices.GetCount() elements.
+	*/
+	void TransformPositions(VertexBuffer const& vertices, f32M44 const& modelToClipMatrix, f32V4* output);
+	/*
+	*	Index driven, only vertices of the given triangles are shaded, on demand through a post-transform cache.
+	*	A vertex evicted from the cache is shaded again when referenced later, others in output are left untouched.
+	*	@triangles: triangle indices surviving culling, in submission order.
+	*	@marks: storage reused between frames, for counting unique vertices.
+	*/
+	void TransformVisibleVertices(VertexBuffer const& vertices, IndexData const& indices, std::vector<u32> const& triangles,
+		f32M44 const& modelToViewMatrix, f32M44 const& modelToClipMatrix, AttributeOutputPackage* output, std::vector<u8>* marks, VertexStatistics* statistics);
+}